@@ -23,11 +23,35 @@
             'dependencies': ['extern/extern.gyp:*'],
             'sources': [
                 'src/binding.cpp',
+                'src/archive.hpp',
+                'src/archive.cpp',
+                'src/arena.hpp',
+                'src/arena.cpp',
+                'src/auth.hpp',
                 'src/base32.hpp',
+                'src/binary_io.hpp',
+                'src/crypto.hpp',
+                'src/crypto.cpp',
+                'src/delta.hpp',
+                'src/delta.cpp',
+                'src/flat_index.hpp',
+                'src/flat_index.cpp',
+                'src/json.hpp',
+                'src/json.cpp',
+                'src/mapped_file.hpp',
+                'src/mapped_file.cpp',
                 'src/package.hpp',
                 'src/package.cpp',
+                'src/package_info.hpp',
+                'src/package_info.cpp',
                 'src/path.hpp',
                 'src/path.cpp',
+                'src/require_scan.hpp',
+                'src/require_scan.cpp',
+                'src/string_ref.hpp',
+                'src/timer.hpp',
+                'src/trace.hpp',
+                'src/trace.cpp',
             ],
             'cflags_cc': ['-std=c++11'],
             'cflags_cc!': ['-fno-rtti', '-fno-exceptions'],
@@ -49,18 +73,80 @@
                 }}},
             },
         },
+        {
+            'target_name': 'iris-crypt-cli',
+            'product_name': 'iris-crypt',
+            'type': 'executable',
+            'dependencies': ['extern/extern.gyp:yas'],
+            'sources': [
+                'src/cli.cpp',
+                'src/archive.hpp',
+                'src/archive.cpp',
+                'src/arena.hpp',
+                'src/arena.cpp',
+                'src/auth.hpp',
+                'src/base32.hpp',
+                'src/binary_io.hpp',
+                'src/crypto.hpp',
+                'src/crypto.cpp',
+                'src/delta.hpp',
+                'src/delta.cpp',
+                'src/flat_index.hpp',
+                'src/flat_index.cpp',
+                'src/json.hpp',
+                'src/json.cpp',
+                'src/mapped_file.hpp',
+                'src/mapped_file.cpp',
+                'src/package_info.hpp',
+                'src/package_info.cpp',
+                'src/path.hpp',
+                'src/path.cpp',
+                'src/require_scan.hpp',
+                'src/require_scan.cpp',
+                'src/string_ref.hpp',
+                'src/timer.hpp',
+                'src/trace.hpp',
+                'src/trace.cpp',
+            ],
+            'cflags_cc': ['-std=c++11', '-pthread'],
+            'cflags_cc!': ['-fno-rtti', '-fno-exceptions'],
+            'conditions': [
+                ['OS=="win"', {
+                    'libraries': ['libcrypto.lib'],
+                }, {
+                    'libraries': ['-lcrypto', '-pthread'],
+                }],
+            ],
+            'xcode_settings': {
+                'GCC_ENABLE_CPP_EXCEPTIONS': 'YES',
+                'GCC_ENABLE_CPP_RTTI': 'YES',
+                'MACOSX_DEPLOYMENT_TARGET': '10.7',
+                'OTHER_CPLUSPLUSFLAGS' : ['-std=c++11', '-stdlib=libc++'],
+                'OTHER_LDFLAGS': ['-stdlib=libc++'],
+            },
+            'configurations': {
+                'Release': { 'msvs_settings': { 'VCCLCompilerTool': {
+                    'ExceptionHandling': 1,
+                    'RuntimeTypeInfo': 'true',
+                }}},
+                'Debug': { 'msvs_settings': { 'VCCLCompilerTool': {
+                    'ExceptionHandling': 1,
+                    'RuntimeTypeInfo': 'true',
+                }}},
+            },
+        },
         {
             'target_name': 'iris-crypt-dist',
             'type': 'none',
-            'dependencies': ['iris-crypt'],
+            'dependencies': ['iris-crypt', 'iris-crypt-cli'],
             'copies': [
                 {
                     'destination': '<(root_dir)/bin',
-                    'files': ['<(PRODUCT_DIR)/<(addon_name).node'],
+                    'files': ['<(PRODUCT_DIR)/<(addon_name).node', '<(PRODUCT_DIR)/iris-crypt<(EXECUTABLE_SUFFIX)'],
                 },
                 {
                     'destination': '<(target_dir)/bin',
-                    'files': ['<(PRODUCT_DIR)/<(addon_name).node'],
+                    'files': ['<(PRODUCT_DIR)/<(addon_name).node', '<(PRODUCT_DIR)/iris-crypt<(EXECUTABLE_SUFFIX)'],
                 },
                 {
                     'destination': '<(target_dir)',
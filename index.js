@@ -7,4 +7,163 @@
 // Distributed under the MIT software license, see the accompanying
 // file LICENSE
 //
-module.exports = require('./bin/iris-crypt_' + process.platform + '_' + process.arch + '_m' + + process.versions.modules + '.node');
+var fs = require('fs');
+var stream = require('stream');
+var util = require('util');
+
+var addon = require('./bin/iris-crypt_' + process.platform + '_' + process.arch + '_m' + + process.versions.modules + '.node');
+
+// Readable stream of a file stored in a package, reads by Package.read()
+function PackageReadStream(pkg, name, options)
+{
+	options = options || {};
+	stream.Readable.call(this, { highWaterMark: options.highWaterMark || 64 * 1024 });
+	this.pkg = pkg;
+	this.name = name;
+	this.pos = options.start || 0;
+	this.end = (options.end === undefined? Infinity : options.end); // inclusive, as in fs.createReadStream()
+}
+util.inherits(PackageReadStream, stream.Readable);
+
+PackageReadStream.prototype._read = function(size)
+{
+	var length = Math.min(size, this.end - this.pos + 1);
+	var chunk = null;
+	if (length > 0)
+	{
+		try { chunk = this.pkg.read(this.name, this.pos, length); }
+		catch (err) { this.emit('error', err); return; }
+	}
+	if (!chunk || chunk.length === 0)
+	{
+		this.push(null);
+		return;
+	}
+	this.pos += chunk.length;
+	this.push(chunk);
+};
+
+addon.Package.prototype.createReadStream = function(name, options)
+{
+	return new PackageReadStream(this, name, options);
+};
+
+// Proxy for a module which is loaded on the first access to its exports.
+// The proxy target is a function, so exported functions may be called.
+// Optional `id` is the name in require() call resolved to `name` in the package
+addon.Package.prototype.lazyRequire = function(name, id)
+{
+	var pkg = this;
+	var exports = null;
+	function load()
+	{
+		if (exports === null) exports = pkg.require(name, true, id);
+		return exports;
+	}
+
+	var target = function() {};
+	return new Proxy(target,
+	{
+		get: function(t, key) { return Reflect.get(load(), key); },
+		set: function(t, key, value) { return Reflect.set(load(), key, value); },
+		has: function(t, key) { return Reflect.has(load(), key); },
+		deleteProperty: function(t, key) { return Reflect.deleteProperty(load(), key); },
+		ownKeys: function(t)
+		{
+			// proxy invariants require to report non-configurable target properties
+			var keys = Reflect.ownKeys(load());
+			Reflect.ownKeys(t).forEach(function(key)
+			{
+				if (!Reflect.getOwnPropertyDescriptor(t, key).configurable && keys.indexOf(key) < 0) keys.push(key);
+			});
+			return keys;
+		},
+		getOwnPropertyDescriptor: function(t, key)
+		{
+			var own = Reflect.getOwnPropertyDescriptor(t, key);
+			if (own && !own.configurable) return own;
+			var desc = Reflect.getOwnPropertyDescriptor(load(), key);
+			if (desc) desc.configurable = true;
+			return desc;
+		},
+		getPrototypeOf: function(t) { return Reflect.getPrototypeOf(load()); },
+		apply: function(t, self, args) { return Reflect.apply(load(), self, args); },
+		construct: function(t, args) { return Reflect.construct(load(), args); },
+	});
+};
+
+// Write files loaded by require() in first-use order, to make a package
+// with package(auth, filename, files, { profile: filename })
+addon.Package.prototype.saveProfile = function(filename)
+{
+	fs.writeFileSync(filename, this.profile.join('\n') + '\n');
+};
+
+// Compile (and optionally evaluate) package modules ahead of their first use
+// in small steps on the event loop, each step takes up to `budgetMs`
+addon.Package.prototype.preload = function(names, options, callback)
+{
+	if (typeof options === 'function')
+	{
+		callback = options;
+		options = {};
+	}
+	options = options || {};
+	callback = callback || function(err) { if (err) throw err; };
+
+	var pkg = this;
+	var budget = options.budgetMs || 5;
+	var evaluate = !!options.evaluate;
+	if (names === 'all')
+	{
+		names = (evaluate? pkg.names : pkg.files.filter(function(file) { return /\.js$/.test(file); }));
+	}
+	else if (!Array.isArray(names))
+	{
+		names = [names];
+	}
+
+	var index = 0;
+	function step()
+	{
+		var start = Date.now();
+		try
+		{
+			while (index < names.length && Date.now() - start < budget)
+			{
+				var name = names[index++];
+				evaluate? pkg.require(name) : pkg.compile(name);
+			}
+		}
+		catch (err)
+		{
+			callback(err);
+			return;
+		}
+		if (index < names.length)
+		{
+			setImmediate(step);
+		}
+		else
+		{
+			callback(null);
+		}
+	}
+	setImmediate(step);
+};
+
+// Write Chrome trace-event JSON recorded since startTrace(),
+// to open in chrome://tracing or Perfetto
+addon.writeTrace = function(filename)
+{
+	fs.writeFileSync(filename, addon.traceEvents());
+};
+
+// Trace the whole process into IRIS_CRYPT_TRACE file
+if (process.env.IRIS_CRYPT_TRACE)
+{
+	addon.startTrace();
+	process.on('exit', function() { addon.writeTrace(process.env.IRIS_CRYPT_TRACE); });
+}
+
+module.exports = addon;
@@ -0,0 +1,1676 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#include "archive.hpp"
+#include "arena.hpp"
+#include "binary_io.hpp"
+#include "delta.hpp"
+#include "json.hpp"
+#include "require_scan.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static uint32_t const SIGN_V0 = 0x30504349; // ICP0, modules and sources in a single message
+static uint32_t const SIGN = 0x31504349; // ICP1, with metadata, blobs and contents in segments
+static uint32_t const SIGN_SHARED = 0x31534349; // ICS1, decrypted package in shared memory
+
+char const archive::module_wrapper_begin[] =
+	"(function (exports, module, __filename, __dirname){"
+	"var require = function(name) { return module.require(name) };";
+char const archive::module_wrapper_end[] = "\n})";
+char const archive::BUNDLE_PATH[] = ".iris-crypt-bundle";
+
+// nonce derived from the key and a hash of the encrypted data: equal data
+// encrypts to equal bytes, so unchanged parts of a package stay the same
+// between its versions and a delta update carries only the changes
+static std::string derive_iv(std::string const& key, std::string const& label,
+	std::string const& hash, size_t size)
+{
+	std::string const data = label + '\0' + hash;
+	return crypto::hmac_sha256(key, data.data(), data.size()).substr(0, size);
+}
+
+// Package metadata and contents are encrypted in content-defined segments,
+// a change in the data changes only the segments around it. Segments section:
+// uint64_t count, uint32_t size and nonce per segment, then the encrypted
+// segments with their auth tags
+static void write_segments(crypto::cipher_type cipher, std::string const& key, string_ref data,
+	std::function<void (char const*, size_t)> const& write)
+{
+	std::vector<uint64_t> const ends = delta::chunk_ends(data.data(), data.size());
+	std::vector<std::string> ivs;
+	std::string table;
+	binary_writer out(table);
+	out.write(static_cast<uint64_t>(ends.size()));
+	for (uint64_t i = 0, begin = 0; i < ends.size(); begin = ends[i++])
+	{
+		size_t const len = static_cast<size_t>(ends[i] - begin);
+		ivs.push_back(derive_iv(key, "segment", crypto::sha256(data.data() + begin, len), crypto::IV_LEN));
+		out.write(static_cast<uint32_t>(len));
+		table += ivs.back();
+	}
+	write(table.data(), table.size());
+
+	std::vector<char> segment;
+	for (uint64_t i = 0, begin = 0; i < ends.size(); begin = ends[i++])
+	{
+		size_t const len = static_cast<size_t>(ends[i] - begin);
+		segment.resize(len + crypto::TAG_LEN);
+		crypto::encrypt(cipher, key, ivs[i], segment.data() + len, data.data() + begin, len, segment.data());
+		write(segment.data(), segment.size());
+	}
+}
+
+// segments section at the reader position, `size` receives the decrypted size
+static string_ref read_segments(binary_reader& in, uint64_t& size)
+{
+	size_t const start = in.pos();
+	char const* const begin = in.take(0);
+	uint64_t const count = in.read<uint64_t>();
+	if (count > in.left() / (sizeof(uint32_t) + crypto::IV_LEN))
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	size = 0;
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		size += in.read<uint32_t>();
+		in.take(crypto::IV_LEN);
+	}
+	if (size > in.left() || count * crypto::TAG_LEN > in.left() - size)
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	in.take(static_cast<size_t>(size + count * crypto::TAG_LEN));
+	return string_ref(begin, in.pos() - start);
+}
+
+// cipher in the package header, ICP0 packages use AES-128-GCM
+static crypto::cipher_type read_cipher(binary_reader& in, uint32_t sign)
+{
+	if (sign != SIGN)
+	{
+		return crypto::AES_128_GCM;
+	}
+	uint8_t const cipher = in.read<uint8_t>();
+	if (cipher != crypto::AES_128_GCM && cipher != crypto::CHACHA20_POLY1305)
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	return static_cast<crypto::cipher_type>(cipher);
+}
+
+// decrypt a segments section returned by read_segments(), or only the segments
+// covering `size` bytes at `offset` of the plain data, into `out`
+static void decrypt_segments(crypto::cipher_type cipher, std::string const& key, string_ref section, char* out,
+	uint64_t offset = 0, uint64_t size = UINT64_MAX)
+{
+	binary_reader table(section.data(), section.size());
+	uint64_t const count = table.read<uint64_t>();
+	binary_reader segments(section.data(), section.size());
+	segments.take(sizeof(uint64_t) + static_cast<size_t>(count) * (sizeof(uint32_t) + crypto::IV_LEN));
+	uint64_t const end = (size > UINT64_MAX - offset? UINT64_MAX : offset + size);
+	std::vector<char> partial;
+	for (uint64_t i = 0, begin = 0; i < count && begin < end; ++i)
+	{
+		size_t const len = table.read<uint32_t>();
+		std::string const iv(table.take(crypto::IV_LEN), crypto::IV_LEN);
+		char const* const segment = segments.take(len + crypto::TAG_LEN);
+		if (begin + len > offset)
+		{
+			if (begin >= offset && begin + len <= end)
+			{
+				crypto::decrypt(cipher, key, iv, segment + len, segment, len, out + (begin - offset));
+			}
+			else
+			{
+				partial.resize(len);
+				crypto::decrypt(cipher, key, iv, segment + len, segment, len, partial.data());
+				uint64_t const from = std::max(begin, offset), to = std::min(begin + len, end);
+				std::memcpy(out + (from - offset), partial.data() + (from - begin), static_cast<size_t>(to - from));
+			}
+		}
+		begin += len;
+	}
+	std::fill(partial.begin(), partial.end(), 0);
+}
+
+void archive::add(std::string const& id, path const& p)
+{
+	p.is_dir() ? add_dir(id, p) : add_file(id, p);
+}
+
+// "main" entry from package.json `content` of module `id`
+static std::string package_main(std::string const& id, path const& file, std::string const& content)
+{
+	json::value json;
+	try { json = json::parse(content); }
+	catch (std::exception const&) {}
+	if (!json.is(json::value::object))
+	{
+		throw std::runtime_error(id + ": can't load " + file.str());
+	}
+	std::string main;
+	if (!json.get("main", main))
+	{
+		throw std::runtime_error(id + ": no \"main\" in " + file.str());
+	}
+	return main;
+}
+
+void archive::add_dir(std::string const& id, path const& p)
+{
+	path const base = p.parent();
+	path main = p / "index.js";
+
+	for (path const& file : p.list_files())
+	{
+		path const name = file.relative_to(base);
+		if (file.relative_to(p) == "package.json")
+		{
+			string_ref const content = add_source(name, file.content());
+			main = p / package_main(id, file, content.str());
+			main.add_extension(".js");
+		}
+		else
+		{
+			add_pending(file, name);
+		}
+	}
+	modules.emplace(id, p.base() / main.relative_to(p));
+	module_dirs_.emplace(id, p.base());
+}
+
+void archive::add_file(std::string const& id, path const& p)
+{
+	add_pending(p, p.base());
+	modules.emplace(id, p.base());
+}
+
+void archive::add_memory_file(std::string const& id, std::string content)
+{
+	path name = id;
+	name.add_extension(".js");
+	add_source(name, std::move(content));
+	modules.emplace(id, name);
+}
+
+void archive::add_memory_dir(std::string const& id, std::map<path, std::string> files)
+{
+	path const dir = id;
+	path main = dir / "index.js";
+
+	for (auto& file : files)
+	{
+		path const name = dir / file.first;
+		if (file.first == "package.json")
+		{
+			main = dir / package_main(id, name, file.second);
+			main.add_extension(".js");
+		}
+		add_source(name, std::move(file.second));
+	}
+	modules.emplace(id, main);
+	module_dirs_.emplace(id, dir);
+}
+
+string_ref archive::add_source(path const& name, std::string content)
+{
+	contents_.emplace_back(std::move(content));
+	string_ref const result(contents_.back());
+	if (is_blob(name, result.size()))
+	{
+		blob_source const src = { path(), result, nullptr, result.size() };
+		blob_sources_.emplace(name, src);
+	}
+	else
+	{
+		sources.emplace(name, result);
+	}
+	return result;
+}
+
+void archive::add_pending(path const& file, path const& name)
+{
+	uint64_t const size = file.size();
+	if (is_blob(name, size))
+	{
+		// blob file is read by blocks while saving
+		blob_source const src = { file, string_ref(), nullptr, size };
+		blob_sources_.emplace(name, src);
+	}
+	else
+	{
+		pending_.emplace_back(file, name);
+	}
+}
+
+bool archive::is_blob(path const& name, uint64_t size) const
+{
+	std::string const ext = name.extension();
+	return size >= blob_min_size && ext != ".js" && ext != ".json";
+}
+
+uint64_t archive::blob::stored_size() const
+{
+	return size + block_count() * (crypto::IV_LEN + crypto::TAG_LEN);
+}
+
+// nonce for block `index` of blob `name`, derived from the block data:
+// unchanged blocks keep their encrypted bytes when other blocks change
+static std::string block_iv(std::string const& key, path const& name, uint64_t index,
+	char const* block, size_t block_len)
+{
+	return derive_iv(key, "blob " + name.str() + '\0' + std::to_string(index),
+		crypto::sha256(block, block_len), crypto::IV_LEN);
+}
+
+size_t archive::read_blob(blob const& b, uint64_t offset, size_t length, char* out) const
+{
+	if (offset >= b.size)
+	{
+		return 0;
+	}
+	length = static_cast<size_t>(std::min<uint64_t>(length, b.size - offset));
+	if (length == 0)
+	{
+		return 0;
+	}
+
+	uint64_t const first = offset / b.block_size;
+	uint64_t const last = (offset + length - 1) / b.block_size;
+	std::vector<char> block;
+	for (uint64_t i = first; i <= last; ++i)
+	{
+		uint64_t const block_begin = i * b.block_size;
+		size_t const block_len = static_cast<size_t>(std::min<uint64_t>(b.block_size, b.size - block_begin));
+		char const* const stored = data_.data() + b.offset + i * (uint64_t(b.block_size) + crypto::IV_LEN + crypto::TAG_LEN);
+		std::string const iv(stored, crypto::IV_LEN);
+		char const* const cipher = stored + crypto::IV_LEN;
+
+		// decrypt whole blocks directly into the output
+		uint64_t const from = std::max(offset, block_begin);
+		uint64_t const to = std::min<uint64_t>(offset + length, block_begin + block_len);
+		char* dest = out + (from - offset);
+		if (from != block_begin || to != block_begin + block_len)
+		{
+			block.resize(block_len);
+			dest = block.data();
+		}
+		crypto::decrypt(key_cipher_, key_, iv, cipher + block_len, cipher, block_len, dest);
+		if (dest == block.data())
+		{
+			std::copy(block.data() + (from - block_begin), block.data() + (to - block_begin), out + (from - offset));
+		}
+	}
+	return length;
+}
+
+void archive::read_files(unsigned threads)
+{
+	// reserve contents, references to deque elements are stable on growth
+	size_t const first = contents_.size();
+	contents_.resize(first + pending_.size());
+
+	std::atomic<size_t> next(0);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+
+	auto read = [&]()
+	{
+		for (size_t i; (i = next++) < pending_.size(); )
+		{
+			try
+			{
+				contents_[first + i] = pending_[i].first.content();
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error) error = std::current_exception();
+				next = pending_.size();
+			}
+		}
+	};
+
+	threads = std::max(1u, std::min<unsigned>(threads, pending_.size()));
+	std::vector<std::thread> workers;
+	for (unsigned i = 1; i < threads; ++i)
+	{
+		workers.emplace_back(read);
+	}
+	read();
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+
+	if (error)
+	{
+		contents_.resize(first);
+		pending_.clear();
+		std::rethrow_exception(error);
+	}
+	for (size_t i = 0; i < pending_.size(); ++i)
+	{
+		sources.emplace(pending_[i].second, string_ref(contents_[first + i]));
+	}
+	pending_.clear();
+}
+
+void archive::save(auth_data const& auth, std::function<void (char const*, size_t)> const& write) const
+{
+	assert(pending_.empty());
+
+	// output is deterministic: hash tables are written sorted and nonces are
+	// derived from the data, so equal inputs give equal package files
+	std::string const key = crypto::cipher_key(cipher, auth.priv_key());
+	std::string plain;
+	binary_writer content(plain);
+	content.write(static_cast<uint32_t>(modules.size()));
+	for (auto const& module : std::map<std::string, path>(modules.begin(), modules.end()))
+	{
+		content.write_bytes(module.first);
+		content.write_bytes(module.second.str());
+	}
+	// files used first are placed in the front, in the profile order,
+	// a loaded archive without profile keeps its stored order
+	std::unordered_map<path, size_t> rank;
+	for (path const& file : (profile.empty() && storage? stored_order() : profile))
+	{
+		rank.emplace(file, rank.size());
+	}
+	auto const layout_order = [&rank](path const& lhs, path const& rhs)
+	{
+		auto const l = rank.find(lhs), r = rank.find(rhs);
+		if (l != rank.end() || r != rank.end())
+		{
+			return r == rank.end() || (l != rank.end() && l->second < r->second);
+		}
+		return lhs < rhs;
+	};
+
+	using source_entry = std::pair<path, string_ref>;
+	std::vector<source_entry> ordered_sources = source_list();
+	std::stable_sort(ordered_sources.begin(), ordered_sources.end(),
+		[&layout_order](source_entry const& lhs, source_entry const& rhs)
+		{ return layout_order(lhs.first, rhs.first); });
+
+	// in bundle mode .js sources are stored in a single script with a module table,
+	// each source is at a known position in the script
+	std::string bundle_source;
+	std::vector<std::pair<path, std::pair<uint64_t, uint64_t>>> bundle_table;
+	if (bundle)
+	{
+		bundle_source = "[\n";
+		for (auto const& source : ordered_sources)
+		{
+			if (source.first.extension() != ".js" || evictable.count(source.first)) continue;
+			bundle_source += module_wrapper_begin;
+			bundle_table.emplace_back(source.first, std::make_pair(bundle_source.size(), source.second.size()));
+			bundle_source.append(source.second.data(), source.second.size());
+			bundle_source += module_wrapper_end;
+			bundle_source += ",\n";
+		}
+		bundle_source += "]";
+	}
+
+	// evictable sources are moved to blobs
+	blob_sources_map evictable_blobs;
+	for (path const& file : evictable)
+	{
+		string_ref source;
+		if (find_source(file, source))
+		{
+			blob_source const src = { path(), source, nullptr, source.size() };
+			evictable_blobs.emplace(file, src);
+		}
+	}
+
+	// only the bundle script is stored inline, other sources follow
+	// in a data section addressed by the flat index at the content end
+	content.write(static_cast<uint32_t>(bundle? 1 : 0));
+	if (bundle)
+	{
+		content.write_bytes(std::string(BUNDLE_PATH));
+		content.write_bytes(bundle_source);
+	}
+	auto const is_stored = [this, &evictable_blobs](source_entry const& source)
+	{
+		return !evictable_blobs.count(source.first) && !(bundle && source.first.extension() == ".js");
+	};
+	uint64_t source_data_size = 0;
+	for (auto const& source : ordered_sources)
+	{
+		if (is_stored(source)) source_data_size += source.second.size();
+	}
+	content.write(source_data_size);
+	std::vector<std::pair<std::string, flat_index::entry>> source_index;
+	uint64_t source_offset = 0;
+	for (auto const& source : ordered_sources)
+	{
+		if (!is_stored(source)) continue;
+		flat_index::entry const e = { source_offset, source.second.size() };
+		source_index.emplace_back(source.first.str(), e);
+		plain.append(source.second.data(), source.second.size());
+		source_offset += source.second.size();
+	}
+
+	std::vector<blob_sources_map::const_pointer> ordered_blobs;
+	for (auto const& src : blob_sources_)
+	{
+		ordered_blobs.emplace_back(&src);
+	}
+	for (auto const& src : evictable_blobs)
+	{
+		ordered_blobs.emplace_back(&src);
+	}
+	std::stable_sort(ordered_blobs.begin(), ordered_blobs.end(),
+		[&layout_order](blob_sources_map::const_pointer lhs, blob_sources_map::const_pointer rhs)
+		{ return layout_order(lhs->first, rhs->first); });
+
+	std::vector<package_info::file> const files = file_infos(true);
+
+	// blobs layout in the data area
+	std::vector<blob> layout;
+	uint64_t offset = 0;
+	content.write(static_cast<uint32_t>(ordered_blobs.size()));
+	for (auto const src_ptr : ordered_blobs)
+	{
+		auto const& src = *src_ptr;
+		blob b;
+		b.offset = offset;
+		b.size = src.second.size;
+		b.block_size = block_size;
+		offset += b.stored_size();
+
+		content.write_bytes(src.first.str());
+		content.write(b.offset);
+		content.write(b.size);
+		content.write(b.block_size);
+		layout.emplace_back(std::move(b));
+	}
+
+	// dependency graph, keep the found dependencies of files without stored sources
+	dependencies_map found_deps = find_dependencies();
+	found_deps.insert(dependencies.begin(), dependencies.end());
+	std::map<path, std::vector<path>> const deps(found_deps.begin(), found_deps.end());
+	content.write(static_cast<uint32_t>(deps.size()));
+	for (auto const& dep : deps)
+	{
+		content.write_bytes(dep.first.str());
+		content.write(static_cast<uint32_t>(dep.second.size()));
+		for (path const& file : dep.second)
+		{
+			content.write_bytes(file.str());
+		}
+	}
+
+	content.write(static_cast<uint32_t>(bundle_table.size()));
+	for (auto const& entry : bundle_table)
+	{
+		content.write_bytes(entry.first.str());
+		content.write(entry.second.first);
+		content.write(entry.second.second);
+	}
+
+	content.write(static_cast<uint32_t>(lazy.size()));
+	for (std::string const& name : lazy)
+	{
+		content.write_bytes(name);
+	}
+
+	content.write_bytes(v8_version);
+	content.write(static_cast<uint32_t>(code_cache.size()));
+	for (auto const& module : std::map<path, compiled_module>(code_cache.begin(), code_cache.end()))
+	{
+		content.write_bytes(module.first.str());
+		content.write(module.second.source_size);
+		content.write_bytes(module.second.cache);
+	}
+
+	std::vector<path> stored_evictable;
+	for (path const& file : evictable)
+	{
+		if (evictable_blobs.count(file) || blob_sources_.count(file)) stored_evictable.emplace_back(file);
+	}
+	content.write(static_cast<uint32_t>(stored_evictable.size()));
+	for (path const& file : stored_evictable)
+	{
+		content.write_bytes(file.str());
+	}
+
+	std::string const index = flat_index::build(std::move(source_index));
+	content.write(static_cast<uint64_t>(index.size()));
+	plain += index;
+
+	// metadata is encrypted separately to read it without the contents
+	package_info::modules_list const info_modules(modules.begin(), modules.end());
+	std::string const info = package_info::build(info_modules, v8_version, files);
+
+	std::string header;
+	binary_writer out(header);
+	out.write(SIGN);
+	out.write_bytes(auth.pub_data());
+	out.write(static_cast<uint8_t>(cipher));
+	write(header.data(), header.size());
+	write_segments(cipher, key, info, write);
+	write_segments(cipher, key, plain, write);
+
+	// encrypt blobs block by block
+	std::vector<char> plain_block(block_size), cipher_block(crypto::IV_LEN + block_size + crypto::TAG_LEN);
+	auto b = layout.begin();
+	for (auto const src_ptr : ordered_blobs)
+	{
+		auto const& src = *src_ptr;
+		std::ifstream file;
+		if (!src.second.file.empty())
+		{
+			file.open(src.second.file.c_str(), std::ios::binary);
+			if (!file.is_open())
+			{
+				throw std::runtime_error("can't open " + src.second.file.str());
+			}
+		}
+
+		for (uint64_t i = 0, count = b->block_count(); i < count; ++i)
+		{
+			uint64_t const block_begin = i * b->block_size;
+			size_t const block_len = static_cast<size_t>(std::min<uint64_t>(b->block_size, b->size - block_begin));
+			char const* block = plain_block.data();
+			if (file.is_open())
+			{
+				if (!file.read(plain_block.data(), block_len))
+				{
+					throw std::runtime_error("can't read " + src.second.file.str() + ", file was changed?");
+				}
+			}
+			else if (src.second.stored)
+			{
+				read_blob(*src.second.stored, block_begin, block_len, plain_block.data());
+			}
+			else
+			{
+				block = src.second.content.data() + block_begin;
+			}
+			std::string const iv = block_iv(key, src.first, i, block, block_len);
+			std::copy(iv.begin(), iv.end(), cipher_block.begin());
+			char* const encrypted = cipher_block.data() + crypto::IV_LEN;
+			crypto::encrypt(cipher, key, iv, encrypted + block_len, block, block_len, encrypted);
+			write(cipher_block.data(), crypto::IV_LEN + block_len + crypto::TAG_LEN);
+		}
+		++b;
+	}
+}
+
+std::string archive::blob_hash(blob_source const& src) const
+{
+	if (!src.file.empty())
+	{
+		std::ifstream file(src.file.c_str(), std::ios::binary);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("can't open " + src.file.str());
+		}
+		crypto::sha256_digest digest;
+		std::vector<char> block(block_size);
+		for (uint64_t pos = 0; pos < src.size; pos += block.size())
+		{
+			size_t const len = static_cast<size_t>(std::min<uint64_t>(block.size(), src.size - pos));
+			if (!file.read(block.data(), len))
+			{
+				throw std::runtime_error("can't read " + src.file.str() + ", file was changed?");
+			}
+			digest.update(block.data(), len);
+		}
+		return digest.finish();
+	}
+	if (src.stored)
+	{
+		crypto::sha256_digest digest;
+		std::vector<char> block(src.stored->block_size);
+		for (uint64_t pos = 0; pos < src.size; pos += block.size())
+		{
+			digest.update(block.data(), read_blob(*src.stored, pos, block.size(), block.data()));
+		}
+		return digest.finish();
+	}
+	return crypto::sha256(src.content.data(), src.content.size());
+}
+
+std::vector<package_info::file> archive::file_infos(bool hashes) const
+{
+	auto const blob_size = [this](uint64_t size)
+	{
+		blob const b = { 0, size, block_size };
+		return b.stored_size();
+	};
+	// hashes of loaded blobs and bytecode sources are kept from the package metadata
+	bool const loaded = static_cast<bool>(storage);
+	auto const stored_hash = [this, loaded](path const& name)
+	{
+		package_info::file f;
+		return (loaded && info().find(name, f)? f.hash : std::string());
+	};
+
+	std::vector<package_info::file> result;
+	for (auto const& source : source_list())
+	{
+		package_info::file f;
+		f.name = source.first;
+		f.size = source.second.size();
+		f.stored_size = f.size;
+		f.kind = package_info::SOURCE;
+		if (evictable.count(source.first))
+		{
+			f.kind = package_info::EVICTABLE;
+			f.stored_size = blob_size(f.size);
+		}
+		else if (bundle && source.first.extension() == ".js")
+		{
+			f.kind = package_info::BUNDLED;
+		}
+		if (hashes)
+		{
+			f.hash = crypto::sha256(source.second.data(), source.second.size());
+		}
+		result.emplace_back(std::move(f));
+	}
+	for (auto const& src : blob_sources_)
+	{
+		package_info::file f;
+		f.name = src.first;
+		f.kind = (evictable.count(src.first)? package_info::EVICTABLE : package_info::BLOB);
+		f.size = src.second.size;
+		f.stored_size = blob_size(f.size);
+		if (hashes)
+		{
+			f.hash = (src.second.stored? stored_hash(src.first) : std::string());
+			if (f.hash.empty())
+			{
+				f.hash = blob_hash(src.second);
+			}
+		}
+		result.emplace_back(std::move(f));
+	}
+	for (auto const& module : code_cache)
+	{
+		package_info::file f;
+		f.name = module.first;
+		f.kind = package_info::BYTECODE;
+		f.size = module.second.source_size;
+		f.stored_size = module.second.cache.size();
+		auto const source = code_sources_.find(module.first);
+		if (source != code_sources_.end())
+		{
+			f.size = source->second.first;
+			f.hash = source->second.second;
+		}
+		else if (hashes && loaded)
+		{
+			package_info::file stored;
+			if (info().find(module.first, stored))
+			{
+				f.size = stored.size;
+				f.hash = stored.hash;
+			}
+		}
+		if (!hashes)
+		{
+			f.hash.clear();
+		}
+		result.emplace_back(std::move(f));
+	}
+	return result;
+}
+
+std::string archive::save(auth_data const& auth) const
+{
+	std::string result;
+	save(auth, [&result](char const* data, size_t size) { result.append(data, size); });
+	return result;
+}
+
+void archive::save(auth_data const& auth, std::string const& filename) const
+{
+	// the package is written into a temporary file and renamed over `filename`
+	// after that, since blobs and metadata may be read from a mapping of `filename`
+	// itself, as in re-encryption of a loaded package in place. The temporary
+	// file name is unique, so concurrent saves of the same package don't collide
+	std::string temp_filename;
+	try
+	{
+		temp_filename = path(filename + ".tmp").create_unique().str();
+	}
+	catch (std::exception const& e)
+	{
+		throw std::runtime_error(std::string("Package write error: ") + e.what());
+	}
+	std::ofstream file(temp_filename.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::remove(temp_filename.c_str());
+		throw std::runtime_error("Package write error: can't open " + temp_filename);
+	}
+	try
+	{
+		save(auth, [&file, &temp_filename](char const* data, size_t size)
+		{
+			if (!file.write(data, size))
+			{
+				throw std::runtime_error("Package write error: can't write " + temp_filename);
+			}
+		});
+		file.close();
+		if (file.fail())
+		{
+			throw std::runtime_error("Package write error: can't write " + temp_filename);
+		}
+		path(temp_filename).rename(filename);
+	}
+	catch (...)
+	{
+		file.close();
+		std::remove(temp_filename.c_str());
+		throw;
+	}
+}
+
+namespace {
+
+// hash table node: value, next pointer and bucket pointer
+template<typename Map>
+uint64_t index_size(Map const& map)
+{
+	return map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*));
+}
+
+} // unnamed namespace
+
+uint64_t archive::memory_size() const
+{
+	uint64_t result = content_.size();
+	result += index_size(modules) + index_size(sources) + index_size(blobs)
+		+ index_size(dependencies) + index_size(bundle_index) + index_size(code_cache);
+	for (auto const& deps : dependencies)
+	{
+		result += deps.second.capacity() * sizeof(path);
+	}
+	for (std::string const& data : contents_)
+	{
+		result += data.capacity();
+	}
+	return result;
+}
+
+// absolute file name, to be opened in other processes
+static std::string absolute_name(std::string const& filename)
+{
+#ifdef __linux__
+	char buf[PATH_MAX];
+	if (realpath(filename.c_str(), buf))
+	{
+		return buf;
+	}
+#endif
+	return filename;
+}
+
+archive archive::load(auth_data const& auth, std::string const& filename)
+{
+	uint64_t const start = monotonic_ns();
+	std::shared_ptr<mapped_file> file = std::make_shared<mapped_file>(filename);
+	uint64_t const read_ns = monotonic_ns() - start;
+	trace::record("read", filename, start, read_ns);
+
+	archive result = load(auth, file->data(), file->size(), file);
+	result.timings.read_ns = read_ns;
+	if (!result.blobs.empty())
+	{
+		result.file_name_ = absolute_name(filename);
+	}
+	return result;
+}
+
+archive archive::load(auth_data const& auth, int fd, uint64_t offset, uint64_t length)
+{
+	uint64_t const start = monotonic_ns();
+	std::shared_ptr<mapped_file> file = std::make_shared<mapped_file>(fd, offset, length);
+	uint64_t const read_ns = monotonic_ns() - start;
+	trace::record("read", "fd " + std::to_string(fd), start, read_ns);
+
+	archive result = load(auth, file->data(), file->size(), file);
+	result.timings.read_ns = read_ns;
+#ifdef __linux__
+	if (!result.blobs.empty())
+	{
+		result.file_name_ = absolute_name("/proc/self/fd/" + std::to_string(fd));
+		result.data_offset_ += offset;
+	}
+#endif
+	return result;
+}
+
+archive archive::load(auth_data const& auth, char const* data, size_t size,
+	std::shared_ptr<void const> data_owner)
+{
+	binary_reader in(data, size);
+
+	uint32_t const sign = in.read<uint32_t>();
+	if (sign != SIGN && sign != SIGN_V0)
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	if (in.read_bytes() != auth.pub_data())
+	{
+		throw std::runtime_error("Package invalid key");
+	}
+	crypto::cipher_type const cipher = read_cipher(in, sign);
+	std::string const key = crypto::cipher_key(cipher, auth.priv_key());
+
+	archive result;
+	result.cipher = cipher;
+	uint64_t decrypt_start = 0;
+	string_ref encrypted;
+	if (sign == SIGN)
+	{
+		// metadata is decrypted on first use while the package data is kept
+		result.info_->segments = read_segments(in, result.info_->size);
+
+		uint64_t size = 0;
+		string_ref const section = read_segments(in, size);
+		encrypted = section;
+
+		decrypt_start = monotonic_ns();
+		std::shared_ptr<char> const arena_block = arena::allocate(static_cast<size_t>(size));
+		decrypt_segments(cipher, key, section, arena_block.get());
+		result.storage = arena_block;
+		result.content_ = string_ref(arena_block.get(), static_cast<size_t>(size));
+	}
+	else
+	{
+		size_t const start = in.pos();
+		std::string const iv = in.read_string();
+		string_ref const auth_tag = in.read_bytes();
+		string_ref const message = in.read_bytes();
+		if (iv.size() != crypto::IV_LEN || auth_tag.size() != crypto::TAG_LEN)
+		{
+			throw std::runtime_error("Package invalid format");
+		}
+		encrypted = string_ref(data + start, in.pos() - start);
+
+		decrypt_start = monotonic_ns();
+		std::shared_ptr<char> const arena_block = arena::allocate(message.size());
+		char* const plain = arena_block.get();
+		crypto::decrypt(cipher, key, iv, auth_tag.data(), message.data(), message.size(), plain);
+		result.storage = arena_block;
+		result.content_ = string_ref(plain, message.size());
+	}
+	result.serial_number = auth.serial_number();
+	result.pub_data_ = auth.pub_data();
+
+	// blobs are read later from the data area
+	uint64_t const deserialize_start = monotonic_ns();
+	string_ref const data_area = (sign == SIGN_V0? string_ref() : string_ref(data + in.pos(), in.left()));
+	result.data_offset_ = in.pos();
+	bool const keep_data = static_cast<bool>(data_owner);
+	if (keep_data)
+	{
+		result.encrypted_ = encrypted;
+	}
+	result.read_content(sign, cipher, key, data_area, std::move(data_owner));
+	if (sign == SIGN && !keep_data)
+	{
+		result.info();
+	}
+	result.timings.decrypt_ns = deserialize_start - decrypt_start;
+	result.timings.deserialize_ns = monotonic_ns() - deserialize_start;
+	trace::record("decrypt", std::string(), decrypt_start, result.timings.decrypt_ns);
+	trace::record("deserialize", std::string(), deserialize_start, result.timings.deserialize_ns);
+	return result;
+}
+
+void archive::read_content(uint32_t sign, crypto::cipher_type cipher, std::string const& key, string_ref data_area,
+	std::shared_ptr<void const> data_owner)
+{
+	// sources refer to the decrypted data
+	sign_ = sign;
+	key_cipher_ = cipher;
+	key_ = key;
+	data_owner_ = std::move(data_owner);
+	binary_reader content(content_.data(), content_.size());
+	for (uint32_t i = 0, count = content.read<uint32_t>(); i != count; ++i)
+	{
+		std::string const id = content.read_string();
+		modules.emplace(id, content.read_string());
+	}
+	uint32_t const sources_count = content.read<uint32_t>();
+	sources.reserve(sources_count);
+	for (uint32_t i = 0; i != sources_count; ++i)
+	{
+		path const name = content.read_string();
+		sources.emplace(name, content.read_bytes());
+	}
+
+	if (sign == SIGN_V0)
+	{
+		return;
+	}
+
+	// used in place with the flat index read below
+	uint64_t const source_data_size = content.read<uint64_t>();
+	if (source_data_size > content.left())
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	source_data_ = string_ref(content.take(static_cast<size_t>(source_data_size)), static_cast<size_t>(source_data_size));
+
+	data_ = data_area;
+	for (uint32_t i = 0, count = content.read<uint32_t>(); i != count; ++i)
+	{
+		path const name = content.read_string();
+		blob b;
+		b.offset = content.read<uint64_t>();
+		b.size = content.read<uint64_t>();
+		b.block_size = content.read<uint32_t>();
+		if (b.block_size == 0 || b.offset > data_.size()
+			|| b.size > data_.size() - b.offset || b.stored_size() > data_.size() - b.offset)
+		{
+			throw std::runtime_error("Package invalid format");
+		}
+		blob const& stored = blobs.emplace(name, std::move(b)).first->second;
+		blob_source const src = { path(), string_ref(), &stored, stored.size };
+		blob_sources_.emplace(name, src);
+	}
+
+	for (uint32_t i = 0, count = content.read<uint32_t>(); i != count; ++i)
+	{
+		std::vector<path>& files = dependencies[content.read_string()];
+		uint32_t const files_count = content.read<uint32_t>();
+		files.reserve(files_count);
+		for (uint32_t j = 0; j != files_count; ++j)
+		{
+			files.emplace_back(content.read_string());
+		}
+	}
+
+	uint32_t const bundle_count = content.read<uint32_t>();
+	if (bundle_count != 0)
+	{
+		read_bundle(content, bundle_count);
+	}
+
+	for (uint32_t i = 0, count = content.read<uint32_t>(); i != count; ++i)
+	{
+		lazy.emplace(content.read_string());
+	}
+
+	v8_version = content.read_string();
+	for (uint32_t i = 0, count = content.read<uint32_t>(); i != count; ++i)
+	{
+		path const name = content.read_string();
+		compiled_module module;
+		module.source_size = content.read<uint64_t>();
+		module.cache = content.read_bytes();
+		code_cache.emplace(name, module);
+	}
+
+	for (uint32_t i = 0, count = content.read<uint32_t>(); i != count; ++i)
+	{
+		evictable.emplace(content.read_string());
+	}
+
+	uint64_t const index_size = content.read<uint64_t>();
+	if (index_size > content.left())
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	source_index_ = flat_index(string_ref(content.take(static_cast<size_t>(index_size)), static_cast<size_t>(index_size)));
+}
+
+package_info const& archive::info() const
+{
+	std::call_once(info_->once, [this]()
+	{
+		if (info_->segments.data())
+		{
+			std::string plain(static_cast<size_t>(info_->size), 0);
+			decrypt_segments(key_cipher_, key_, info_->segments, &plain[0]);
+			info_->info = package_info(std::move(plain));
+		}
+		else
+		{
+			package_info::modules_list const info_modules(modules.begin(), modules.end());
+			info_->info = package_info(package_info::build(info_modules, v8_version, file_infos(false)));
+		}
+	});
+	return info_->info;
+}
+
+package_info archive::inspect(auth_data const& auth, std::string const& filename)
+{
+	trace::span span("inspect", filename);
+	std::shared_ptr<mapped_file> const file = std::make_shared<mapped_file>(filename);
+	binary_reader in(file->data(), file->size());
+	uint32_t const sign = in.read<uint32_t>();
+	if (sign != SIGN)
+	{
+		return load(auth, file->data(), file->size(), file).info();
+	}
+	if (in.read_bytes() != auth.pub_data())
+	{
+		throw std::runtime_error("Package invalid key");
+	}
+	crypto::cipher_type const cipher = read_cipher(in, sign);
+	uint64_t size = 0;
+	string_ref const section = read_segments(in, size);
+	std::string plain(static_cast<size_t>(size), 0);
+	decrypt_segments(cipher, crypto::cipher_key(cipher, auth.priv_key()), section, &plain[0]);
+	return package_info(std::move(plain));
+}
+
+bool archive::find_source(path const& file, string_ref& source) const
+{
+	auto const it = sources.find(file);
+	if (it != sources.end())
+	{
+		source = it->second;
+		return true;
+	}
+	flat_index::entry e;
+	if (!source_index_.find(file.str(), e))
+	{
+		return false;
+	}
+	if (e.offset > source_data_.size() || e.size > source_data_.size() - e.offset)
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	source = string_ref(source_data_.data() + e.offset, static_cast<size_t>(e.size));
+	return true;
+}
+
+std::string archive::decrypt_content(string_ref part) const
+{
+	uint64_t const offset = part.data() - content_.data();
+	std::string result(part.size(), 0);
+	if (sign_ == SIGN)
+	{
+		decrypt_segments(key_cipher_, key_, encrypted_, &result[0], offset, part.size());
+	}
+	else
+	{
+		// the single message is authenticated only as a whole
+		binary_reader in(encrypted_.data(), encrypted_.size());
+		std::string const iv = in.read_string();
+		string_ref const auth_tag = in.read_bytes();
+		string_ref const message = in.read_bytes();
+		std::vector<char> plain(message.size());
+		crypto::decrypt(key_cipher_, key_, iv, auth_tag.data(), message.data(), message.size(), plain.data());
+		result.assign(plain.data() + offset, part.size());
+		std::fill(plain.begin(), plain.end(), 0);
+	}
+	return result;
+}
+
+bool archive::copy_source(path const& file, std::string& source) const
+{
+	string_ref content;
+	if (!find_source(file, content))
+	{
+		return false;
+	}
+	// other sources are kept for readFile(), decrypted contents of packages
+	// from buffers or shared memory can't be restored, and bundled sources
+	// are parts of the bundle script compiled by each package
+	if (file.extension() != ".js" || !encrypted_.data() || bundle_index.count(file))
+	{
+		source.assign(content.data(), content.size());
+		return true;
+	}
+	{
+		std::lock_guard<std::mutex> lock(wiped_->mutex);
+		if (wiped_->files.insert(file).second)
+		{
+			source.assign(content.data(), content.size());
+			std::memset(const_cast<char*>(content.data()), 0, content.size());
+			return true;
+		}
+	}
+	trace::span span("decrypt", file.str());
+	source = decrypt_content(content);
+	return true;
+}
+
+bool archive::has_source(path const& file) const
+{
+	string_ref source;
+	return find_source(file, source);
+}
+
+size_t archive::source_count() const
+{
+	return sources.size() + source_index_.size();
+}
+
+std::vector<std::pair<path, string_ref>> archive::source_list() const
+{
+	std::vector<std::pair<path, string_ref>> result(sources.begin(), sources.end());
+	result.reserve(source_count());
+	for (size_t i = 0; i < source_index_.size(); ++i)
+	{
+		flat_index::entry const e = source_index_.value(i);
+		if (e.offset > source_data_.size() || e.size > source_data_.size() - e.offset)
+		{
+			throw std::runtime_error("Package invalid format");
+		}
+		result.emplace_back(source_index_.key(i), string_ref(source_data_.data() + e.offset, static_cast<size_t>(e.size)));
+	}
+	return result;
+}
+
+std::vector<path> archive::stored_order() const
+{
+	// sources, bundled sources and blobs are placed in separate areas,
+	// each of them in the layout order
+	std::vector<std::pair<uint64_t, path>> source_files, bundle_files, blob_files;
+	for (size_t i = 0; i < source_index_.size(); ++i)
+	{
+		source_files.emplace_back(source_index_.value(i).offset, source_index_.key(i));
+	}
+	for (auto const& entry : bundle_index)
+	{
+		bundle_files.emplace_back(entry.second, entry.first);
+	}
+	for (auto const& entry : blobs)
+	{
+		blob_files.emplace_back(entry.second.offset, entry.first);
+	}
+
+	std::vector<path> result;
+	for (auto* files : { &source_files, &bundle_files, &blob_files })
+	{
+		std::sort(files->begin(), files->end());
+		for (auto const& file : *files)
+		{
+			result.emplace_back(file.second);
+		}
+	}
+	return result;
+}
+
+void archive::add_code_cache(path const& file, uint64_t source_size, std::string cache)
+{
+	string_ref source;
+	if (find_source(file, source))
+	{
+		code_sources_[file] = std::make_pair(uint64_t(source.size()), crypto::sha256(source.data(), source.size()));
+	}
+	contents_.emplace_back(std::move(cache));
+	compiled_module const module = { source_size, string_ref(contents_.back()) };
+	code_cache[file] = module;
+	sources.erase(file);
+}
+
+void archive::read_bundle(binary_reader& content, uint32_t bundle_count)
+{
+	auto const bundle_source = sources.find(BUNDLE_PATH);
+	if (bundle_source == sources.end())
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	bundle = true;
+	bundle_script = bundle_source->second;
+	sources.erase(bundle_source);
+
+	// bundled sources refer to their text in the bundle script
+	bundle_index.reserve(bundle_count);
+	for (uint32_t i = 0; i != bundle_count; ++i)
+	{
+		path const name = content.read_string();
+		uint64_t const offset = content.read<uint64_t>();
+		uint64_t const size = content.read<uint64_t>();
+		if (offset > bundle_script.size() || size > bundle_script.size() - offset)
+		{
+			throw std::runtime_error("Package invalid format");
+		}
+		sources.emplace(name, string_ref(bundle_script.data() + offset, static_cast<size_t>(size)));
+		bundle_index.emplace(name, i);
+	}
+}
+
+size_t archive::mark_evictable(std::vector<std::string> const& patterns)
+{
+	size_t count = 0;
+	for (auto const& source : source_list())
+	{
+		path const& file = source.first;
+		std::string const ext = file.extension();
+		if ((ext != ".js" && ext != ".json") || code_cache.count(file))
+		{
+			continue;
+		}
+		if (patterns.empty() || std::any_of(patterns.begin(), patterns.end(),
+			[&file](std::string const& pattern) { return file.match(pattern); }))
+		{
+			count += evictable.insert(file).second;
+		}
+	}
+	return count;
+}
+
+archive::prune_result archive::prune(prune_rules const& rules)
+{
+	assert(pending_.empty());
+
+	std::unordered_set<path> keep;
+	std::vector<path> queue;
+	auto const reach = [&keep, &queue](path const& file)
+	{
+		if (keep.insert(file).second) queue.emplace_back(file);
+	};
+	auto const is_stored = [this](path const& file)
+	{
+		return sources.find(file) != sources.end() || blob_sources_.find(file) != blob_sources_.end();
+	};
+
+	for (auto const& module : modules)
+	{
+		reach(module.second);
+	}
+
+	std::vector<std::string> keep_patterns = rules.include;
+	for (auto const& entry : rules.entries)
+	{
+		auto const dir = module_dirs_.find(entry.first);
+		if (dir == module_dirs_.end())
+		{
+			throw std::runtime_error(entry.first + ": no module directory for entry point " + entry.second.str());
+		}
+		path file = dir->second / entry.second;
+		file.add_extension(".js");
+		if (!is_stored(file))
+		{
+			throw std::runtime_error(entry.first + ": no entry point " + file.str());
+		}
+		reach(file);
+	}
+	for (auto const& dir : module_dirs_)
+	{
+		path const package_json = dir.second / "package.json";
+		auto const src = sources.find(package_json);
+		if (src == sources.end())
+		{
+			continue;
+		}
+		reach(package_json);
+
+		// "files" in package.json lists files and directories of the module
+		json::value json;
+		try { json = json::parse(src->second.str()); }
+		catch (std::exception const&) {}
+		for (json::value const& item : json["files"].as_array())
+		{
+			if (item.is(json::value::string))
+			{
+				path const pattern = dir.second / item.as_string();
+				keep_patterns.emplace_back(pattern.str());
+				keep_patterns.emplace_back((pattern / "**").str());
+			}
+		}
+	}
+
+	auto const matches = [](path const& file, std::vector<std::string> const& patterns)
+	{
+		return std::any_of(patterns.begin(), patterns.end(),
+			[&file](std::string const& pattern) { return file.match(pattern); });
+	};
+	for (auto const& source : sources)
+	{
+		if (matches(source.first, keep_patterns)) reach(source.first);
+	}
+	for (auto const& src : blob_sources_)
+	{
+		if (matches(src.first, keep_patterns)) reach(src.first);
+	}
+
+	// static require() reachability
+	while (!queue.empty())
+	{
+		path const file = queue.back();
+		queue.pop_back();
+		auto const src = sources.find(file);
+		if (src == sources.end() || file.extension() != ".js")
+		{
+			continue;
+		}
+		for (std::string const& name : scan_requires(src->second))
+		{
+			path const dep = resolve(file, name);
+			if (!dep.empty()) reach(dep);
+		}
+	}
+
+	std::unordered_set<path> mains;
+	for (auto const& module : modules)
+	{
+		mains.insert(module.second);
+	}
+	auto const removed = [&](path const& file)
+	{
+		return (keep.find(file) == keep.end() || matches(file, rules.exclude))
+			&& mains.find(file) == mains.end();
+	};
+
+	prune_result result;
+	for (auto it = sources.begin(); it != sources.end(); )
+	{
+		if (!removed(it->first)) { ++it; continue; }
+		result.files.emplace_back(it->first);
+		result.bytes += it->second.size();
+		it = sources.erase(it);
+	}
+	for (auto it = blob_sources_.begin(); it != blob_sources_.end(); )
+	{
+		if (!removed(it->first)) { ++it; continue; }
+		result.files.emplace_back(it->first);
+		result.bytes += it->second.size;
+		it = blob_sources_.erase(it);
+	}
+	std::sort(result.files.begin(), result.files.end());
+	return result;
+}
+
+std::vector<path> archive::read_profile(std::string const& filename)
+{
+	std::ifstream file(filename.c_str());
+	if (!file.is_open())
+	{
+		throw std::runtime_error("can't open " + filename);
+	}
+
+	std::vector<path> result;
+	for (std::string line; std::getline(file, line); )
+	{
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		if (!line.empty() && line[0] != '#')
+		{
+			result.emplace_back(line);
+		}
+	}
+	return result;
+}
+
+path archive::resolve(path const& from, std::string const& name) const
+{
+	if (name.empty())
+	{
+		return path();
+	}
+
+	// the same rules as in package::require()
+	auto const module = modules.find(name);
+	if (module != modules.end())
+	{
+		return module->second;
+	}
+	if (name[0] != '.')
+	{
+		return path();
+	}
+	path result = from.parent() / name;
+	result.add_extension(".js");
+	return has_source(result)? result : path();
+}
+
+archive::dependencies_map archive::find_dependencies() const
+{
+	dependencies_map result;
+	for (auto const& source : source_list())
+	{
+		if (source.first.extension() != ".js")
+		{
+			continue;
+		}
+		std::vector<path> files;
+		for (std::string const& name : scan_requires(source.second))
+		{
+			path const file = resolve(source.first, name);
+			if (!file.empty() && file != source.first
+				&& std::find(files.begin(), files.end(), file) == files.end())
+			{
+				files.emplace_back(file);
+			}
+		}
+		if (!files.empty())
+		{
+			result.emplace(source.first, std::move(files));
+		}
+	}
+	return result;
+}
+
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING)
+
+int archive::share_memory() const
+{
+	if (!storage)
+	{
+		throw std::runtime_error("only a loaded package can be shared");
+	}
+
+	// not inherited by every process spawned later,
+	// the descriptor is passed to child processes explicitly
+	int const fd = memfd_create("iris-crypt", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+	{
+		throw std::runtime_error("can't create shared memory: " + std::string(strerror(errno)));
+	}
+
+	std::string header;
+	binary_writer out(header);
+	out.write(SIGN_SHARED);
+	out.write_bytes(pub_data_);
+	out.write(sign_);
+	out.write(static_cast<uint8_t>(key_cipher_));
+	out.write<uint64_t>(content_.size());
+	string_ref const info_data = info().data();
+
+	auto write = [fd](char const* data, size_t size)
+	{
+		while (size > 0)
+		{
+			ssize_t const written = ::write(fd, data, size);
+			if (written < 0 && errno == EINTR) continue;
+			if (written <= 0)
+			{
+				throw std::runtime_error("can't write shared memory: " + std::string(strerror(errno)));
+			}
+			data += written;
+			size -= written;
+		}
+	};
+	try
+	{
+		write(header.data(), header.size());
+		write(content_.data(), content_.size());
+
+		// sources wiped after compile are decrypted again for child processes
+		std::vector<path> wiped;
+		{
+			std::lock_guard<std::mutex> lock(wiped_->mutex);
+			wiped.assign(wiped_->files.begin(), wiped_->files.end());
+		}
+		for (path const& file : wiped)
+		{
+			string_ref content;
+			find_source(file, content);
+			std::string source = decrypt_content(content);
+			off_t const pos = static_cast<off_t>(header.size() + (content.data() - content_.data()));
+			ssize_t const written = pwrite(fd, source.data(), source.size(), pos);
+			std::fill(source.begin(), source.end(), 0);
+			if (written != static_cast<ssize_t>(source.size()))
+			{
+				throw std::runtime_error("can't write shared memory: " + std::string(strerror(errno)));
+			}
+		}
+		uint64_t const info_size = info_data.size();
+		write(reinterpret_cast<char const*>(&info_size), sizeof(info_size));
+		write(info_data.data(), info_data.size());
+
+		// blobs are mapped from the package file, packages loaded
+		// from memory have no file and their data area is copied
+		bool const data_in_file = !file_name_.empty();
+		std::string data_header;
+		binary_writer data_out(data_header);
+		data_out.write_bytes(data_in_file? file_name_ : std::string());
+		data_out.write<uint64_t>(data_in_file? data_offset_ : 0);
+		data_out.write<uint64_t>(data_.size());
+		write(data_header.data(), data_header.size());
+		if (!data_in_file)
+		{
+			write(data_.data(), data_.size());
+		}
+
+		// readers can rely on the contents to be immutable
+		if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+		{
+			throw std::runtime_error("can't seal shared memory: " + std::string(strerror(errno)));
+		}
+	}
+	catch (...)
+	{
+		close(fd);
+		throw;
+	}
+	return fd;
+}
+
+archive archive::load_shared(auth_data const& auth, int fd)
+{
+	int const seals = fcntl(fd, F_GET_SEALS);
+	if (seals < 0 || (seals & F_SEAL_WRITE) == 0 || (seals & F_SEAL_SHRINK) == 0)
+	{
+		throw std::runtime_error("file descriptor " + std::to_string(fd) + " is not a sealed shared package");
+	}
+
+	uint64_t const start = monotonic_ns();
+	std::shared_ptr<mapped_file> file = std::make_shared<mapped_file>(fd, 0);
+	binary_reader in(file->data(), file->size());
+	if (in.read<uint32_t>() != SIGN_SHARED)
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	if (in.read_bytes() != auth.pub_data())
+	{
+		throw std::runtime_error("Package invalid key");
+	}
+
+	archive result;
+	result.serial_number = auth.serial_number();
+	result.pub_data_ = auth.pub_data();
+	uint32_t const sign = in.read<uint32_t>();
+	crypto::cipher_type const cipher = read_cipher(in, SIGN);
+	result.cipher = cipher;
+	uint64_t const content_size = in.read<uint64_t>();
+	if (content_size > in.left())
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	char const* const content = file->data() + in.pos();
+	in.take(content_size);
+
+	// sources refer to the shared pages, kept mapped with the storage
+	result.storage = std::shared_ptr<char const>(file, content);
+	result.content_ = string_ref(content, content_size);
+	uint64_t const info_size = in.read<uint64_t>();
+	if (info_size > in.left())
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	std::string info(in.take(static_cast<size_t>(info_size)), static_cast<size_t>(info_size));
+	std::call_once(result.info_->once, [&result, &info]() { result.info_->info = package_info(std::move(info)); });
+	std::string const data_file = in.read_string();
+	uint64_t const data_offset = in.read<uint64_t>();
+	uint64_t const data_size = in.read<uint64_t>();
+	std::shared_ptr<mapped_file> data = file;
+	string_ref data_area;
+	if (data_file.empty())
+	{
+		if (data_size > in.left())
+		{
+			throw std::runtime_error("Package invalid format");
+		}
+		data_area = string_ref(in.take(static_cast<size_t>(data_size)), static_cast<size_t>(data_size));
+	}
+	else
+	{
+		// blob blocks are authenticated, so a changed package file fails on read
+		int const data_fd = open(data_file.c_str(), O_RDONLY | O_CLOEXEC);
+		if (data_fd < 0)
+		{
+			throw std::runtime_error("can't open shared package file " + data_file + ": " + strerror(errno));
+		}
+		try
+		{
+			data = std::make_shared<mapped_file>(data_fd, data_offset, data_size);
+		}
+		catch (...)
+		{
+			close(data_fd);
+			throw;
+		}
+		close(data_fd);
+		data_area = string_ref(data->data(), data->size());
+		result.file_name_ = data_file;
+		result.data_offset_ = data_offset;
+	}
+
+	uint64_t const deserialize_start = monotonic_ns();
+	result.read_content(sign, cipher, crypto::cipher_key(cipher, auth.priv_key()), data_area, data);
+	result.timings.read_ns = deserialize_start - start;
+	result.timings.deserialize_ns = monotonic_ns() - deserialize_start;
+	trace::record("read", "shared fd " + std::to_string(fd), start, result.timings.read_ns);
+	trace::record("deserialize", std::string(), deserialize_start, result.timings.deserialize_ns);
+	return result;
+}
+
+#else
+
+int archive::share_memory() const
+{
+	throw std::runtime_error("shared memory packages are supported only on Linux");
+}
+
+archive archive::load_shared(auth_data const&, int)
+{
+	throw std::runtime_error("shared memory packages are supported only on Linux");
+}
+
+#endif
@@ -0,0 +1,325 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "auth.hpp"
+#include "crypto.hpp"
+#include "flat_index.hpp"
+#include "mapped_file.hpp"
+#include "package_info.hpp"
+#include "path.hpp"
+#include "string_ref.hpp"
+
+class binary_reader;
+
+// Package file contents: module names with their main files and file sources.
+// Doesn't depend on V8, so it is shared by the addon and the command-line tool.
+class archive
+{
+public:
+	using sources_map = std::unordered_map<path, string_ref>;
+	using modules_map = std::unordered_map<std::string, path>;
+
+	modules_map modules;
+
+	// serial number of the auth key for a loaded archive
+	uint16_t serial_number = 0;
+
+	// durations of load() stages: file mapping, decryption, index parsing
+	struct load_timings
+	{
+		uint64_t read_ns = 0;
+		uint64_t decrypt_ns = 0;
+		uint64_t deserialize_ns = 0;
+	};
+	load_timings timings;
+
+	// file sources refer either to the decrypted package memory in `storage`,
+	// an arena block wiped on release, or to contents of the files added to the archive
+	sources_map sources;
+	std::shared_ptr<char const> storage;
+
+	// source of `file` from `sources` or the index of a loaded package
+	bool find_source(path const& file, string_ref& source) const;
+	bool has_source(path const& file) const;
+	size_t source_count() const;
+
+	// copy of the source of `file` to compile. Plain .js sources of a package
+	// loaded from a file, except bundled ones, are wiped after the first copy,
+	// and decrypted again from the package file for later copies in packages
+	// sharing the archive
+	bool copy_source(path const& file, std::string& source) const;
+
+	// all sources in no particular order
+	std::vector<std::pair<path, string_ref>> source_list() const;
+
+	// large file stored as a sequence of separately encrypted blocks
+	// in the package data area after the encrypted content,
+	// each block is stored with its nonce and auth tag
+	struct blob
+	{
+		uint64_t offset;      // in the data area
+		uint64_t size;        // plain data size
+		uint32_t block_size;  // plain block size
+
+		uint64_t block_count() const { return (size + block_size - 1) / block_size; }
+		uint64_t stored_size() const;
+	};
+	using blobs_map = std::unordered_map<path, blob>;
+	blobs_map blobs;
+
+	// static require() dependencies of .js files in the archive,
+	// found on save() and stored in the package index
+	using dependencies_map = std::unordered_map<path, std::vector<path>>;
+	dependencies_map dependencies;
+
+	// bundle mode: .js sources are stored in a single script, an array
+	// of module wrapper functions indexed in `bundle_index`
+	bool bundle = false;
+	string_ref bundle_script;
+	std::unordered_map<path, uint32_t> bundle_index;
+
+	// names in require() calls to load on the first use of the module
+	std::set<std::string> lazy;
+
+	// .js and .json files stored as blobs, decrypted on each require()
+	// and dropped after compile, so their modules may be evicted
+	std::set<path> evictable;
+
+	// bytecode mode: V8 code cache of wrapped module sources, stored instead
+	// of .js sources, usable only with the same V8 version
+	struct compiled_module
+	{
+		uint64_t source_size; // wrapped source length, for a placeholder source
+		string_ref cache;
+	};
+	std::unordered_map<path, compiled_module> code_cache;
+	std::string v8_version;
+
+	// replace source of `file` with its code cache
+	void add_code_cache(path const& file, uint64_t source_size, std::string cache);
+
+	// module source is wrapped into a function with these parts
+	static char const module_wrapper_begin[];
+	static char const module_wrapper_end[];
+
+	// files in first-use order, placed first in the package on save(),
+	// other files follow sorted by path. Without profile a loaded archive
+	// is saved in its stored order
+	std::vector<path> profile;
+
+	// files of this size and larger, except .js and .json, are stored as blobs
+	// when added to the archive
+	uint64_t blob_min_size = 1024 * 1024;
+	uint32_t block_size = 64 * 1024;
+
+	// cipher for save(), of a loaded package for loaded archives
+	crypto::cipher_type cipher = crypto::AES_128_GCM;
+
+	archive() = default;
+	archive(archive&&) = default;
+	archive& operator=(archive&&) = default;
+
+	archive(archive const&) = delete;
+	archive& operator=(archive const&) = delete;
+
+	// add module `id` from a directory or a single file `p`,
+	// file contents are read later in read_files()
+	void add(std::string const& id, path const& p);
+
+	// add module `id` with a single file `content`, stored as `id` path
+	// with default .js extension
+	void add_memory_file(std::string const& id, std::string content);
+
+	// add module `id` from a set of files with their contents, stored under `id` directory
+	void add_memory_dir(std::string const& id, std::map<path, std::string> files);
+
+	// read contents of the added files into memory with a number of threads,
+	// files stored as blobs are not read, they are streamed on save()
+	void read_files(unsigned threads = 1);
+
+	// rules to remove files unreachable from module entry points
+	struct prune_rules
+	{
+		// additional entry points relative to a module directory, by module id
+		std::multimap<std::string, path> entries;
+		// glob patterns for files to keep and to remove in any case
+		std::vector<std::string> include, exclude;
+	};
+
+	struct prune_result
+	{
+		std::vector<path> files;
+		uint64_t bytes = 0;
+	};
+
+	// keep only files reachable with static require() from module main files
+	// and entry points, module package.json files with their "files" field,
+	// and files matching include patterns, except ones matching exclude patterns.
+	// Should be called after read_files(), returns removed files and their size
+	prune_result prune(prune_rules const& rules);
+
+	// mark .js and .json sources matching any of glob `patterns`, or all of them
+	// when `patterns` are empty, as evictable. Returns number of marked files
+	size_t mark_evictable(std::vector<std::string> const& patterns);
+
+	// file in the archive for `require(name)` called in `from` file,
+	// empty if it is not stored in the archive
+	path resolve(path const& from, std::string const& name) const;
+
+	// scan .js sources for static require() calls
+	dependencies_map find_dependencies() const;
+
+	// read up to `length` bytes at `offset` in a stored blob into `out`,
+	// only the blocks covering the range are decrypted, return number of read bytes
+	size_t read_blob(blob const& b, uint64_t offset, size_t length, char* out) const;
+
+	// size of the decrypted package index and sources held in memory
+	uint64_t content_size() const { return content_.size(); }
+
+	// approximate native memory held: decrypted content and index
+	uint64_t memory_size() const;
+
+	// metadata of a loaded archive: from the package header, decrypted on first use,
+	// or made from the contents for packages of previous versions, without hashes
+	package_info const& info() const;
+
+	// read a profile file with a file path per line, made with Package.saveProfile()
+	static std::vector<path> read_profile(std::string const& filename);
+
+	// encrypt the archive into package file contents
+	std::string save(auth_data const& auth) const;
+
+	// encrypt and write the archive into a package file
+	void save(auth_data const& auth, std::string const& filename) const;
+
+	// read and decrypt a package file
+	static archive load(auth_data const& auth, std::string const& filename);
+
+	// read and decrypt a package stored at `offset` in open file descriptor `fd`,
+	// up to the end of file if `length` is mapped_file::npos
+	static archive load(auth_data const& auth, int fd, uint64_t offset, uint64_t length);
+
+	// decrypt a package from memory, `data` is not copied and should be alive
+	// while blobs are read, optionally with `data_owner` to keep it
+	static archive load(auth_data const& auth, char const* data, size_t size,
+		std::shared_ptr<void const> data_owner = nullptr);
+
+	// copy the decrypted contents of a loaded archive into a sealed memory file
+	// (Linux memfd), return its close-on-exec descriptor to pass to child processes.
+	// Blobs are not copied, they are read from the package file
+	int share_memory() const;
+
+	// map the decrypted contents from a memory file created by share_memory()
+	// and blobs from the package file
+	static archive load_shared(auth_data const& auth, int fd);
+
+	// decrypt only the package metadata, packages of previous versions are loaded in full
+	static package_info inspect(auth_data const& auth, std::string const& filename);
+private:
+	static char const BUNDLE_PATH[];
+
+	void read_bundle(binary_reader& content, uint32_t bundle_count);
+	void read_content(uint32_t sign, crypto::cipher_type cipher, std::string const& key, string_ref data_area,
+		std::shared_ptr<void const> data_owner);
+
+	void add_dir(std::string const& id, path const& p);
+	void add_file(std::string const& id, path const& p);
+
+	string_ref add_source(path const& name, std::string content);
+	void add_pending(path const& file, path const& name);
+	bool is_blob(path const& name, uint64_t size) const;
+
+	void save(auth_data const& auth, std::function<void (char const*, size_t)> const& write) const;
+
+	// files of a loaded archive in the order of their placement in the package
+	std::vector<path> stored_order() const;
+
+	// stored files for the package metadata, optionally with content hashes
+	std::vector<package_info::file> file_infos(bool hashes) const;
+
+	// blob contents for save(): file on disk, memory, or a blob in loaded package
+	struct blob_source
+	{
+		path file;
+		string_ref content;
+		blob const* stored;
+		uint64_t size;
+	};
+	using blob_sources_map = std::map<path, blob_source>;
+	blob_sources_map blob_sources_;
+
+	std::string blob_hash(blob_source const& src) const;
+
+	// size and hash of sources replaced with code cache
+	std::unordered_map<path, std::pair<uint64_t, std::string>> code_sources_;
+
+	// decrypted contents of a loaded archive in `storage`, with its key public data
+	string_ref content_;
+	std::string pub_data_;
+	uint32_t sign_ = 0;
+
+	// encrypted contents in the kept package data to decrypt wiped sources again:
+	// segments section of ICP1, or nonce, tag and message of ICP0
+	string_ref encrypted_;
+	struct wiped_state
+	{
+		std::mutex mutex;
+		std::unordered_set<path> files;
+	};
+	std::shared_ptr<wiped_state> wiped_ = std::make_shared<wiped_state>();
+	std::string decrypt_content(string_ref part) const;
+
+	// sources of a loaded package without the inline ones in `sources`
+	string_ref source_data_;
+	flat_index source_index_;
+
+	// package metadata, encrypted in segments in the package header
+	struct info_state
+	{
+		std::once_flag once;
+		package_info info;
+		string_ref segments;
+		uint64_t size = 0;
+	};
+	std::shared_ptr<info_state> info_ = std::make_shared<info_state>();
+
+	// cipher, key and package data area for loaded blobs
+	crypto::cipher_type key_cipher_ = crypto::AES_128_GCM;
+	std::string key_;
+	string_ref data_;
+	std::shared_ptr<void const> data_owner_;
+
+	// absolute name of the loaded package file and offset of the data area in it,
+	// for blobs in shared memory packages
+	std::string file_name_;
+	uint64_t data_offset_ = 0;
+
+	// directories of modules added from directories, by module id
+	std::unordered_map<std::string, path> module_dirs_;
+
+	// contents of added files
+	std::deque<std::string> contents_;
+
+	// files to read, with their names in sources
+	std::vector<std::pair<path, path>> pending_;
+};
@@ -0,0 +1,151 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#include "arena.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace arena {
+
+namespace {
+
+// memset through a volatile pointer is not removed as a dead store
+void* (*volatile wipe_memory)(void*, int, size_t) = memset;
+
+std::mutex pool_mutex;
+std::multimap<size_t, char*> pool;
+size_t pool_size = 0;
+size_t used_size = 0;
+
+size_t page_size()
+{
+#ifdef _WIN32
+	static size_t const size = []()
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return static_cast<size_t>(info.dwPageSize);
+	}();
+	return size;
+#else
+	static size_t const size = sysconf(_SC_PAGESIZE);
+	return size;
+#endif
+}
+
+char* map_pages(size_t capacity)
+{
+#ifdef _WIN32
+	void* const mem = VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (!mem)
+	{
+		throw std::bad_alloc();
+	}
+	return static_cast<char*>(mem);
+#else
+	void* const mem = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+	{
+		throw std::bad_alloc();
+	}
+#ifdef MADV_DONTDUMP
+	madvise(mem, capacity, MADV_DONTDUMP);
+#endif
+	return static_cast<char*>(mem);
+#endif
+}
+
+void unmap_pages(char* mem, size_t capacity)
+{
+#ifdef _WIN32
+	(void)capacity;
+	VirtualFree(mem, 0, MEM_RELEASE);
+#else
+	munmap(mem, capacity);
+#endif
+}
+
+void release(char* mem, size_t capacity)
+{
+	wipe_memory(mem, 0, capacity);
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		used_size -= capacity;
+		if (pool_size + capacity <= pool_limit)
+		{
+			pool.emplace(capacity, mem);
+			pool_size += capacity;
+			return;
+		}
+	}
+	unmap_pages(mem, capacity);
+}
+
+} // unnamed namespace
+
+std::shared_ptr<char> allocate(size_t size)
+{
+	size_t capacity = (std::max<size_t>(size, 1) + page_size() - 1) / page_size() * page_size();
+	char* mem = nullptr;
+	{
+		// reuse a released block up to twice larger
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		auto const it = pool.lower_bound(capacity);
+		if (it != pool.end() && it->first / 2 <= capacity)
+		{
+			capacity = it->first;
+			mem = it->second;
+			pool_size -= capacity;
+			pool.erase(it);
+		}
+	}
+	if (!mem)
+	{
+		mem = map_pages(capacity);
+	}
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		used_size += capacity;
+	}
+	return std::shared_ptr<char>(mem, [capacity](char* mem) { release(mem, capacity); });
+}
+
+size_t in_use()
+{
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	return used_size;
+}
+
+void trim()
+{
+	std::multimap<size_t, char*> blocks;
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		blocks.swap(pool);
+		pool_size = 0;
+	}
+	for (auto const& block : blocks)
+	{
+		unmap_pages(block.second, block.first);
+	}
+}
+
+} // namespace arena
@@ -0,0 +1,31 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+// Page-aligned memory for decrypted package contents, excluded from core
+// dumps where supported. Released memory is wiped and kept for reuse by
+// later loads up to `pool_limit` bytes.
+namespace arena {
+
+size_t const pool_limit = 64 * 1024 * 1024;
+
+// at least `size` bytes, released when the last owner is gone
+std::shared_ptr<char> allocate(size_t size);
+
+// bytes allocated and not released yet
+size_t in_use();
+
+// free the memory kept for reuse
+void trim();
+
+} // namespace arena
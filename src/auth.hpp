@@ -0,0 +1,85 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+#include "base32.hpp"
+#include "crypto.hpp"
+
+// Auth key like XXXX-XXXX-XXXX-XXXX-XXXX-XXXX-YYYY-ZZZZ
+class auth_data
+{
+	// result string is in Base32, so binary data should be
+	// a multipler for 40 bit block.
+	static size_t const KEY_LEN = crypto::KEY_LEN;
+	static size_t const AUTH_LEN = KEY_LEN + sizeof(uint16_t) * 2; // + serial + checksum
+	std::string data_;
+public:
+	auth_data(std::string const& password, uint16_t serial_number)
+	{
+		std::string const salt((char*)&serial_number, sizeof(serial_number));
+		// XXXX
+		data_ = crypto::pbkdf2(password, salt, 1000, KEY_LEN);
+		// YYYY
+		data_.append(salt);
+		// ZZZZ
+		uint16_t const checksum = std::accumulate(data_.begin(), data_.end(), uint16_t{});
+		data_.append((char*)&checksum, sizeof(checksum));
+	}
+
+	explicit auth_data(std::string str)
+	{
+		str.erase(std::remove(str.begin(), str.end(), '-'), str.end());
+		try { data_ = base32::decode<base32::crockford>(str); }
+		catch (std::exception const&) {};
+
+		if (data_.size() != AUTH_LEN
+			|| checksum() != std::accumulate(data_.begin(), data_.end() - sizeof(uint16_t), uint16_t{}))
+		{
+			throw std::runtime_error("invalid auth data");
+		}
+	}
+
+	std::string to_string(size_t const group_by = 4) const
+	{
+		std::string result = base32::encode<base32::crockford>(data_);
+		if (group_by)
+		{
+			for (auto pos = result.begin() + group_by; pos < result.end();)
+			{
+				pos = result.insert(pos, '-') + group_by + 1;
+			}
+		}
+		return result;
+	}
+
+	uint16_t serial_number() const
+	{
+		uint16_t result;
+		memcpy(&result, data_.data() + KEY_LEN, sizeof(result));
+		return result;
+	}
+
+	uint16_t checksum() const
+	{
+		uint16_t result;
+		memcpy(&result, data_.data() + KEY_LEN + sizeof(uint16_t), sizeof(result));
+		return result;
+	}
+
+	std::string pub_data() const { return data_.substr(KEY_LEN); }
+	std::string priv_key() const { return data_.substr(0, KEY_LEN); }
+};
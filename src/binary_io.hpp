@@ -0,0 +1,125 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "string_ref.hpp"
+
+// Package data is stored in little-endian byte order with uint32_t
+// size prefixes for byte arrays, compatible with yas binary archives.
+
+// Bounds checked reader of binary data in memory
+class binary_reader
+{
+public:
+	binary_reader(char const* data, size_t size)
+		: begin_(data)
+		, cur_(data)
+		, end_(data + size)
+	{
+	}
+
+	template<typename T>
+	T read()
+	{
+		static_assert(std::is_arithmetic<T>::value, "arithmetic type required");
+		T result;
+		memcpy(&result, take(sizeof(result)), sizeof(result));
+		return result;
+	}
+
+	// size-prefixed byte array, refers to the reader memory
+	string_ref read_bytes()
+	{
+		size_t const size = read<uint32_t>();
+		return string_ref(take(size), size);
+	}
+
+	std::string read_string()
+	{
+		return read_bytes().str();
+	}
+
+	// byte array with uint64_t size prefix, refers to the reader memory
+	string_ref read_large_bytes()
+	{
+		uint64_t const size = read<uint64_t>();
+		if (size > left())
+		{
+			throw std::runtime_error("Package read error: unexpected end of data");
+		}
+		return string_ref(take(static_cast<size_t>(size)), static_cast<size_t>(size));
+	}
+
+	char const* take(size_t size)
+	{
+		if (size > size_t(end_ - cur_))
+		{
+			throw std::runtime_error("Package read error: unexpected end of data");
+		}
+		char const* const result = cur_;
+		cur_ += size;
+		return result;
+	}
+
+	size_t pos() const { return cur_ - begin_; }
+	size_t left() const { return end_ - cur_; }
+
+private:
+	char const* begin_;
+	char const* cur_;
+	char const* end_;
+};
+
+// Writer of binary data appending to a string
+class binary_writer
+{
+public:
+	explicit binary_writer(std::string& out)
+		: out_(out)
+	{
+	}
+
+	template<typename T>
+	void write(T value)
+	{
+		static_assert(std::is_arithmetic<T>::value, "arithmetic type required");
+		out_.append(reinterpret_cast<char const*>(&value), sizeof(value));
+	}
+
+	// size-prefixed byte array
+	void write_bytes(string_ref bytes)
+	{
+		if (bytes.size() > UINT32_MAX)
+		{
+			throw std::runtime_error("Package write error: data is too large");
+		}
+		write(static_cast<uint32_t>(bytes.size()));
+		out_.append(bytes.data(), bytes.size());
+	}
+
+	// reserve `size` bytes to fill later, return their position
+	size_t reserve(size_t size)
+	{
+		size_t const pos = out_.size();
+		out_.append(size, 0);
+		return pos;
+	}
+
+	size_t pos() const { return out_.size(); }
+
+private:
+	std::string& out_;
+};
@@ -8,6 +8,8 @@
 // file LICENSE
 //
 #include "package.hpp"
+#include "delta.hpp"
+#include "trace.hpp"
 
 #include <node.h>
 
@@ -15,36 +17,48 @@
 #include <v8pp/class.hpp>
 #include <v8pp/property.hpp>
 #include <v8pp/object.hpp>
-#include <v8pp/call_v8.hpp>
 
-static void init(v8::Handle<v8::Object>, v8::Handle<v8::Object> module)
+// The addon may be loaded in several isolates (main thread and worker threads),
+// each one gets its own state and class bindings
+static void init(v8::Handle<v8::Object>, v8::Handle<v8::Value> module_value,
+	v8::Handle<v8::Context> context, void*)
 {
-	v8::Isolate* isolate = v8::Isolate::GetCurrent();
+	v8::Isolate* isolate = context->GetIsolate();
 	v8::HandleScope scope(isolate);
 
+	v8::Local<v8::Object> module = module_value.As<v8::Object>();
+	package::isolate_state& state = package::init_state(isolate);
+
 	// store persistent handle to this module object
-	package::node_module.Reset(isolate, module);
+	state.node_module.Reset(isolate, module);
 	v8::Local<v8::Function> require;
 
 	// get original Node.js require() function
 	v8pp::get_option(isolate, module, "require", require);
-	package::node_require.Reset(isolate, require);
-
-	// load Node.js crypto module
-	v8::Local<v8::Object> crypto = v8pp::call_v8(isolate, require, module, "crypto").As<v8::Object>();
-	if (crypto.IsEmpty() || crypto->IsUndefined())
-	{
-		v8pp::set_option(isolate, module, "exports", v8pp::throw_ex(isolate, "can't load crypto module"));
-		return;
-	}
-
-	package::node_crypto.Reset(isolate, crypto);
+	state.node_require.Reset(isolate, require);
 
 	v8pp::class_<package> package_class(isolate);
 	package_class
 		.set("require", &package::require)
+		.set("readFile", &package::read_file)
+		.set("read", &package::read)
+		.set("compile", &package::compile)
+		.set("dependencies", &package::dependencies)
+		.set("prefetch", v8pp::property(&package::prefetch, &package::set_prefetch))
+		.set("share", &package::share)
+		.set("shareMemory", &package::share_memory)
 		.set("serial", v8pp::property(&package::serial))
 		.set("names", v8pp::property(&package::names))
+		.set("files", v8pp::property(&package::files))
+		.set("has", &package::has)
+		.set("stat", &package::stat)
+		.set("list", &package::list)
+		.set("profile", v8pp::property(&package::profile))
+		.set("stats", &package::stats)
+		.set("statsEnabled", v8pp::property(&package::stats_enabled, &package::set_stats_enabled))
+		.set("memoryLimit", v8pp::property(&package::memory_limit, &package::set_memory_limit))
+		.set("close", &package::close)
+		.set("closed", v8pp::property(&package::closed))
 		;
 	v8pp::module exports(isolate);
 	exports
@@ -52,16 +66,27 @@ static void init(v8::Handle<v8::Object>, v8::Handle<v8::Object> module)
 		.set("generateAuth", package::gen_auth)
 		.set("package", package::make)
 		.set("load", package::load)
+		.set("attach", package::attach)
+		.set("loadShared", package::load_shared)
+		.set("inspect", package::inspect)
+		.set("diff", package::diff)
+		.set("patch", delta::patch)
+		.set("startTrace", trace::start)
+		.set("stopTrace", trace::stop)
+		.set("traceEvents", trace::events_json)
 		;
 
 	v8pp::set_option(isolate, module, "exports", exports.new_instance());
 
-	node::AtExit([](void*)
+	auto cleanup = [](void* arg)
 	{
-		package::node_crypto.Reset();
-		package::node_require.Reset();
-		package::node_module.Reset();
-	});
+		package::release_state(static_cast<v8::Isolate*>(arg));
+	};
+#if NODE_MODULE_VERSION >= 64
+	node::AddEnvironmentCleanupHook(isolate, cleanup, isolate);
+#else
+	node::AtExit(cleanup, isolate);
+#endif
 }
 
-NODE_MODULE(lmdb_node, init);
+NODE_MODULE_CONTEXT_AWARE(iris_crypt, init);
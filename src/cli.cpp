@@ -0,0 +1,542 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+// Command-line tool to make and inspect packages without Node.js
+//
+#include "archive.hpp"
+#include "auth.hpp"
+#include "crypto.hpp"
+#include "delta.hpp"
+#include "path.hpp"
+#include "timer.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <glob.h>
+#endif
+
+static char const usage[] =
+	"Usage: iris-crypt <command> [options]\n"
+	"\n"
+	"Commands:\n"
+	"  pack   -a AUTH -o OUTPUT [-j THREADS] [-m MANIFEST] [-p PROFILE] [-c CIPHER]\n"
+	"         [-B] [-l NAME]... [-E GLOB]... [-P] [-e NAME:ENTRY]... [-i GLOB]... [-x GLOB]...\n"
+	"         [NAME=PATH | PATH]...\n"
+	"         create a package from modules listed in a manifest file and command line,\n"
+	"         files listed in a profile saved by Package.saveProfile() are placed first;\n"
+	"         -P, -e, -i, -x keep only files reachable from module entry points,\n"
+	"         -B stores .js files in a single bundle script,\n"
+	"         -l makes require(NAME) in the package return a lazy loading proxy,\n"
+	"         -E stores matching .js and .json files as evictable modules,\n"
+	"         -c sets the cipher: aes-128-gcm (default) or chacha20-poly1305\n"
+	"  list   -a AUTH PACKAGE\n"
+	"         list modules and files stored in a package with their sizes,\n"
+	"         kinds and SHA-256 hashes, only the package metadata is decrypted\n"
+	"  verify -a AUTH [-j THREADS] PACKAGE...\n"
+	"         check packages can be decrypted with the auth key\n"
+	"  rekey  -a AUTH -n NEW_AUTH [-o OUTPUT] [-c CIPHER] PACKAGE\n"
+	"         re-encrypt a package with another auth key, optionally with another cipher\n"
+	"  stat   -a AUTH PACKAGE...\n"
+	"         print package statistics\n"
+	"  diff   -o DELTA OLD_PACKAGE NEW_PACKAGE\n"
+	"         write a delta to update OLD_PACKAGE to NEW_PACKAGE\n"
+	"  patch  -o NEW_PACKAGE OLD_PACKAGE DELTA\n"
+	"         apply a delta made with diff to OLD_PACKAGE\n"
+	"  bench\n"
+	"         measure encryption and decryption speed of the ciphers on this machine\n"
+	"\n"
+	"Auth key may be set in IRIS_CRYPT_AUTH environment variable instead of -a option.\n"
+	"Manifest file contains a module per line as `NAME PATH` or `PATH`, where PATH\n"
+	"may be a glob pattern relative to the manifest file location. Module name\n"
+	"defaults to the file name without extension. Lines starting with # are ignored.\n";
+
+struct usage_error : std::runtime_error
+{
+	explicit usage_error(std::string const& what) : std::runtime_error(what) {}
+};
+
+struct options
+{
+	std::string command;
+	std::string auth, new_auth;
+	std::string output;
+	std::string manifest;
+	std::string profile;
+	std::string cipher;
+	bool prune = false;
+	bool bundle = false;
+	std::set<std::string> lazy;
+	std::vector<std::string> evictable;
+	archive::prune_rules prune_rules;
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::string> args;
+
+	options(int argc, char* argv[])
+	{
+		if (argc < 2) throw usage_error("no command");
+		command = argv[1];
+
+		if (char const* env_auth = getenv("IRIS_CRYPT_AUTH")) auth = env_auth;
+
+		for (int i = 2; i < argc; ++i)
+		{
+			std::string const arg = argv[i];
+			if (arg == "-P")
+			{
+				prune = true;
+			}
+			else if (arg == "-B")
+			{
+				bundle = true;
+			}
+			else if (arg.size() == 2 && arg[0] == '-')
+			{
+				if (i + 1 == argc) throw usage_error("missing value for " + arg);
+				std::string const value = argv[++i];
+				switch (arg[1])
+				{
+				case 'a': auth = value; break;
+				case 'n': new_auth = value; break;
+				case 'o': output = value; break;
+				case 'm': manifest = value; break;
+				case 'p': profile = value; break;
+				case 'c': cipher = value; break;
+				case 'l': lazy.insert(value); break;
+				case 'E': evictable.emplace_back(value); break;
+				case 'e': add_entry(value); break;
+				case 'i': prune = true; prune_rules.include.emplace_back(value); break;
+				case 'x': prune = true; prune_rules.exclude.emplace_back(value); break;
+				case 'j': threads = std::max(1, atoi(value.c_str())); break;
+				default: throw usage_error("unknown option " + arg);
+				}
+			}
+			else args.emplace_back(arg);
+		}
+	}
+
+	void add_entry(std::string const& value)
+	{
+		std::string::size_type const sep = value.find(':');
+		if (sep == value.npos || sep == 0 || sep + 1 == value.size())
+		{
+			throw usage_error("expected NAME:ENTRY for -e option");
+		}
+		prune = true;
+		prune_rules.entries.emplace(value.substr(0, sep), value.substr(sep + 1));
+	}
+
+	auth_data get_auth() const
+	{
+		if (auth.empty()) throw usage_error("no auth key");
+		return auth_data(auth);
+	}
+};
+
+static std::vector<path> expand(path const& pattern)
+{
+	std::vector<path> result;
+#ifndef _WIN32
+	glob_t matches;
+	if (glob(pattern.c_str(), 0, nullptr, &matches) == 0)
+	{
+		for (size_t i = 0; i < matches.gl_pathc; ++i)
+		{
+			result.emplace_back(matches.gl_pathv[i]);
+		}
+	}
+	globfree(&matches);
+#endif
+	if (result.empty())
+	{
+		if (!pattern.is_dir() && !pattern.is_file())
+		{
+			throw std::runtime_error("no such file: " + pattern.str());
+		}
+		result.emplace_back(pattern);
+	}
+	return result;
+}
+
+static std::string module_name(path const& p)
+{
+	std::string name = p.base().str();
+	if (!p.is_dir())
+	{
+		std::string const ext = p.base().extension();
+		name.resize(name.size() - ext.size());
+	}
+	return name;
+}
+
+// add module `name` (may be empty) at `pattern` path into `modules`
+static void add_module(std::map<std::string, path>& modules, std::string const& name, path const& pattern)
+{
+	std::vector<path> const files = expand(pattern);
+	if (!name.empty() && files.size() > 1)
+	{
+		throw std::runtime_error("module " + name + ": " + pattern.str() + " matches several files");
+	}
+	for (path const& file : files)
+	{
+		std::string const id = name.empty()? module_name(file) : name;
+		if (!modules.emplace(id, file).second)
+		{
+			throw std::runtime_error("duplicate module name " + id);
+		}
+	}
+}
+
+static void read_manifest(std::map<std::string, path>& modules, std::string const& filename)
+{
+	std::ifstream file(filename.c_str());
+	if (!file.is_open())
+	{
+		throw std::runtime_error("can't open " + filename);
+	}
+
+	path const base = path(filename).parent();
+	for (std::string line; std::getline(file, line); )
+	{
+		line.erase(0, line.find_first_not_of(" \t"));
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		if (line.empty() || line[0] == '#') continue;
+
+		std::string name, file_path = line;
+		std::string::size_type const sep = line.find_first_of(" \t");
+		if (sep != line.npos)
+		{
+			name = line.substr(0, sep);
+			file_path = line.substr(line.find_first_not_of(" \t", sep));
+		}
+		bool const absolute = (file_path[0] == '/' || file_path[0] == '\\'
+			|| (file_path.size() > 1 && file_path[1] == ':'));
+		add_module(modules, name, absolute || base.empty()? path(file_path) : base / file_path);
+	}
+}
+
+static int pack(options const& opts)
+{
+	auth_data const auth = opts.get_auth();
+	if (opts.output.empty()) throw usage_error("no output package file");
+
+	std::map<std::string, path> modules;
+	if (!opts.manifest.empty())
+	{
+		read_manifest(modules, opts.manifest);
+	}
+	for (std::string const& arg : opts.args)
+	{
+		std::string::size_type const eq = arg.find('=');
+		eq == arg.npos? add_module(modules, "", arg)
+			: add_module(modules, arg.substr(0, eq), arg.substr(eq + 1));
+	}
+	if (modules.empty()) throw usage_error("no modules to pack");
+
+	archive ar;
+	ar.bundle = opts.bundle;
+	ar.lazy = opts.lazy;
+	if (!opts.cipher.empty())
+	{
+		ar.cipher = crypto::cipher_by_name(opts.cipher);
+	}
+	for (auto const& module : modules)
+	{
+		ar.add(module.first, module.second);
+	}
+	ar.read_files(opts.threads);
+	if (opts.prune)
+	{
+		archive::prune_result const pruned = ar.prune(opts.prune_rules);
+		for (path const& file : pruned.files)
+		{
+			std::cout << "pruned " << file.str() << '\n';
+		}
+		std::cout << "pruned " << pruned.files.size() << " files, " << pruned.bytes << " bytes\n";
+	}
+	if (!opts.evictable.empty())
+	{
+		ar.mark_evictable(opts.evictable);
+	}
+	if (!opts.profile.empty())
+	{
+		ar.profile = archive::read_profile(opts.profile);
+	}
+	ar.save(auth, opts.output);
+	return EXIT_SUCCESS;
+}
+
+static int list(options const& opts)
+{
+	auth_data const auth = opts.get_auth();
+	if (opts.args.size() != 1) throw usage_error("expected single package file");
+
+	package_info const info = archive::inspect(auth, opts.args.front());
+
+	std::cout << "modules:\n";
+	for (auto const& module : info.modules())
+	{
+		std::cout << "  " << module.first << " -> " << module.second.str() << '\n';
+	}
+	std::cout << "files:\n";
+	for (package_info::file const& file : info.list())
+	{
+		std::cout << "  " << file.name.str() << ' ' << file.size
+			<< ' ' << package_info::kind_name(file.kind);
+		if (!file.hash.empty())
+		{
+			std::cout << ' ' << file.hash_hex();
+		}
+		std::cout << '\n';
+	}
+	return EXIT_SUCCESS;
+}
+
+static int verify(options const& opts)
+{
+	auth_data const auth = opts.get_auth();
+	if (opts.args.empty()) throw usage_error("no package files");
+
+	std::atomic<size_t> next(0), failed(0);
+	std::mutex output_mutex;
+	auto check = [&]()
+	{
+		for (size_t i; (i = next++) < opts.args.size(); )
+		{
+			std::string const& filename = opts.args[i];
+			std::string error;
+			try
+			{
+				archive const ar = archive::load(auth, filename);
+				// authenticate all blob blocks
+				std::vector<char> block;
+				for (auto const& blob : ar.blobs)
+				{
+					block.resize(blob.second.block_size);
+					for (uint64_t pos = 0; pos < blob.second.size; pos += block.size())
+					{
+						ar.read_blob(blob.second, pos, block.size(), block.data());
+					}
+				}
+			}
+			catch (std::exception const& ex) { error = ex.what(); }
+
+			std::lock_guard<std::mutex> lock(output_mutex);
+			if (error.empty())
+			{
+				std::cout << filename << ": OK\n";
+			}
+			else
+			{
+				++failed;
+				std::cout << filename << ": FAILED " << error << '\n';
+			}
+		}
+	};
+
+	unsigned const threads = std::min<unsigned>(opts.threads, opts.args.size());
+	std::vector<std::thread> workers;
+	for (unsigned i = 1; i < threads; ++i)
+	{
+		workers.emplace_back(check);
+	}
+	check();
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+	return failed? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int rekey(options const& opts)
+{
+	auth_data const auth = opts.get_auth();
+	if (opts.new_auth.empty()) throw usage_error("no new auth key");
+	if (opts.args.size() != 1) throw usage_error("expected single package file");
+
+	auth_data const new_auth(opts.new_auth);
+	std::string const& filename = opts.args.front();
+
+	archive ar = archive::load(auth, filename);
+	if (!opts.cipher.empty())
+	{
+		ar.cipher = crypto::cipher_by_name(opts.cipher);
+	}
+	ar.save(new_auth, opts.output.empty()? filename : opts.output);
+	return EXIT_SUCCESS;
+}
+
+static int stat(options const& opts)
+{
+	auth_data const auth = opts.get_auth();
+	if (opts.args.empty()) throw usage_error("no package files");
+
+	for (std::string const& filename : opts.args)
+	{
+		package_info const info = archive::inspect(auth, filename);
+
+		struct ::stat st;
+		if (::stat(filename.c_str(), &st) != 0)
+		{
+			throw std::runtime_error("can't stat " + filename);
+		}
+
+		uint64_t plain_size = 0, blobs_size = 0;
+		size_t sources = 0, blobs = 0, bundled = 0, evictable = 0, bytecode = 0;
+		for (package_info::file const& file : info.list())
+		{
+			switch (file.kind)
+			{
+			case package_info::BUNDLED:
+				++bundled;
+				// fall through
+			case package_info::SOURCE:
+				++sources;
+				plain_size += file.size;
+				break;
+			case package_info::EVICTABLE:
+				++evictable;
+				// fall through
+			case package_info::BLOB:
+				++blobs;
+				blobs_size += file.size;
+				break;
+			case package_info::BYTECODE:
+				++bytecode;
+				break;
+			}
+		}
+
+		std::cout << filename << ":\n"
+			<< "  serial: " << auth.serial_number() << '\n'
+			<< "  modules: " << info.modules().size() << '\n'
+			<< "  files: " << sources << '\n'
+			<< "  source bytes: " << plain_size << '\n'
+			<< "  blobs: " << blobs << '\n'
+			<< "  blob bytes: " << blobs_size << '\n'
+			<< "  bundled files: " << bundled << '\n'
+			<< "  evictable files: " << evictable << '\n'
+			<< "  bytecode files: " << bytecode
+			<< (info.v8_version().empty()? "" : " for V8 " + info.v8_version()) << '\n'
+			<< "  package bytes: " << st.st_size << '\n';
+	}
+	return EXIT_SUCCESS;
+}
+
+static int diff(options const& opts)
+{
+	if (opts.output.empty()) throw usage_error("no output delta file");
+	if (opts.args.size() != 2) throw usage_error("expected old and new package files");
+
+	delta::diff_result const result = delta::diff(opts.args[0], opts.args[1], opts.output);
+	std::cout << opts.output << ": " << result.size << " bytes, "
+		<< result.copied << " bytes copied, " << result.added << " bytes added\n";
+	return EXIT_SUCCESS;
+}
+
+static int patch(options const& opts)
+{
+	if (opts.output.empty()) throw usage_error("no output package file");
+	if (opts.args.size() != 2) throw usage_error("expected old package and delta files");
+
+	delta::patch(opts.args[0], opts.args[1], opts.output);
+	return EXIT_SUCCESS;
+}
+
+// throughput of the ciphers for package blob blocks, in MB/s
+static int bench(options const& opts)
+{
+	if (!opts.args.empty()) throw usage_error("unexpected arguments");
+
+	size_t const block_size = archive().block_size;
+	size_t const total_size = 64 * 1024 * 1024;
+	std::string const iv = crypto::random_bytes(crypto::IV_LEN);
+	std::vector<char> plain(block_size), cipher(block_size), tag(crypto::TAG_LEN);
+	std::generate(plain.begin(), plain.end(), std::rand);
+
+	auto const mb_per_s = [total_size](uint64_t start)
+	{
+		double const seconds = (monotonic_ns() - start) / 1e9;
+		return static_cast<uint64_t>(total_size / seconds / 1e6);
+	};
+
+	std::cout << "cipher throughput for " << block_size << " bytes blocks:\n";
+	for (crypto::cipher_type type : { crypto::AES_128_GCM, crypto::CHACHA20_POLY1305 })
+	{
+		std::cout << "  " << crypto::cipher_name(type) << ": ";
+		if (!crypto::cipher_available(type))
+		{
+			std::cout << "not supported by OpenSSL\n";
+			continue;
+		}
+		std::string const key = crypto::cipher_key(type, crypto::random_bytes(crypto::KEY_LEN));
+
+		uint64_t start = monotonic_ns();
+		for (size_t done = 0; done < total_size; done += block_size)
+		{
+			crypto::encrypt(type, key, iv, tag.data(), plain.data(), block_size, cipher.data());
+		}
+		uint64_t const encrypt_speed = mb_per_s(start);
+
+		start = monotonic_ns();
+		for (size_t done = 0; done < total_size; done += block_size)
+		{
+			crypto::decrypt(type, key, iv, tag.data(), cipher.data(), block_size, plain.data());
+		}
+		uint64_t const decrypt_speed = mb_per_s(start);
+
+		std::cout << "encrypt " << encrypt_speed << " MB/s, decrypt " << decrypt_speed << " MB/s\n";
+	}
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[])
+try
+{
+	options const opts(argc, argv);
+
+	if (opts.command == "pack") return pack(opts);
+	if (opts.command == "list") return list(opts);
+	if (opts.command == "verify") return verify(opts);
+	if (opts.command == "rekey") return rekey(opts);
+	if (opts.command == "stat") return stat(opts);
+	if (opts.command == "diff") return diff(opts);
+	if (opts.command == "patch") return patch(opts);
+	if (opts.command == "bench") return bench(opts);
+	if (opts.command == "help" || opts.command == "-h" || opts.command == "--help")
+	{
+		std::cout << usage;
+		return EXIT_SUCCESS;
+	}
+	throw usage_error("unknown command " + opts.command);
+}
+catch (usage_error const& ex)
+{
+	std::cerr << "iris-crypt: " << ex.what() << "\n\n" << usage;
+	return 2;
+}
+catch (std::exception const& ex)
+{
+	std::cerr << "iris-crypt: " << ex.what() << '\n';
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,250 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#include "crypto.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+namespace crypto {
+
+namespace {
+
+struct cipher_ctx_deleter
+{
+	void operator()(EVP_CIPHER_CTX* ctx) const { EVP_CIPHER_CTX_free(ctx); }
+};
+
+using cipher_ctx = std::unique_ptr<EVP_CIPHER_CTX, cipher_ctx_deleter>;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(OPENSSL_NO_CHACHA) && !defined(OPENSSL_NO_POLY1305)
+#define IRIS_CRYPT_HAS_CHACHA20_POLY1305
+#endif
+
+EVP_CIPHER const* evp_cipher(cipher_type type)
+{
+	switch (type)
+	{
+	case AES_128_GCM:
+		return EVP_aes_128_gcm();
+#ifdef IRIS_CRYPT_HAS_CHACHA20_POLY1305
+	case CHACHA20_POLY1305:
+		return EVP_chacha20_poly1305();
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+// GCM control codes are the same as AEAD ones used for ChaCha20-Poly1305
+cipher_ctx new_cipher_ctx(cipher_type type, bool encrypt, std::string const& key, std::string const& iv)
+{
+	assert(iv.size() == IV_LEN);
+
+	EVP_CIPHER const* cipher = evp_cipher(type);
+	if (!cipher)
+	{
+		throw std::runtime_error(std::string(cipher_name(type)) + " cipher is not supported by OpenSSL");
+	}
+	assert(key.size() == (size_t)EVP_CIPHER_key_length(cipher));
+
+	cipher_ctx ctx(EVP_CIPHER_CTX_new());
+	if (!ctx
+		|| !EVP_CipherInit_ex(ctx.get(), cipher, nullptr, nullptr, nullptr, encrypt)
+		|| !EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, (int)iv.size(), nullptr)
+		|| !EVP_CipherInit_ex(ctx.get(), nullptr, nullptr,
+			(unsigned char const*)key.data(), (unsigned char const*)iv.data(), encrypt))
+	{
+		throw std::runtime_error(encrypt? "encryption failed" : "decryption failed");
+	}
+	return ctx;
+}
+
+// EVP_CipherUpdate() accepts int sizes, so process large data in pieces
+bool cipher_update(EVP_CIPHER_CTX* ctx, char const* data, size_t size, char* out)
+{
+	size_t const max_piece = INT_MAX & ~size_t(0xFFFF);
+	while (size)
+	{
+		int const piece = (int)std::min(size, max_piece);
+		int out_len = 0;
+		if (!EVP_CipherUpdate(ctx, (unsigned char*)out, &out_len, (unsigned char const*)data, piece))
+		{
+			return false;
+		}
+		data += piece;
+		out += out_len;
+		size -= piece;
+	}
+	return true;
+}
+
+} // unnamed namespace
+
+std::string random_bytes(size_t size)
+{
+	std::string result(size, 0);
+	if (size && RAND_bytes((unsigned char*)&result[0], (int)size) != 1)
+	{
+		throw std::runtime_error("random bytes generation failed");
+	}
+	return result;
+}
+
+std::string pbkdf2(std::string const& password, std::string const& salt,
+	size_t iterations, size_t keylen)
+{
+	std::string result(keylen, 0);
+	if (!PKCS5_PBKDF2_HMAC(password.data(), (int)password.size(),
+		(unsigned char const*)salt.data(), (int)salt.size(), (int)iterations,
+		EVP_sha256(), (int)keylen, (unsigned char*)&result[0]))
+	{
+		throw std::runtime_error("pbkdf2 failed");
+	}
+	return result;
+}
+
+std::string sha256(char const* data, size_t size)
+{
+	std::string result(EVP_MAX_MD_SIZE, 0);
+	unsigned int len = 0;
+	if (!EVP_Digest(data, size, (unsigned char*)&result[0], &len, EVP_sha256(), nullptr))
+	{
+		throw std::runtime_error("sha256 failed");
+	}
+	result.resize(len);
+	return result;
+}
+
+std::string hmac_sha256(std::string const& key, char const* data, size_t size)
+{
+	std::string result(EVP_MAX_MD_SIZE, 0);
+	unsigned int len = 0;
+	if (!HMAC(EVP_sha256(), key.data(), (int)key.size(), (unsigned char const*)data, size,
+		(unsigned char*)&result[0], &len))
+	{
+		throw std::runtime_error("hmac failed");
+	}
+	result.resize(len);
+	return result;
+}
+
+sha256_digest::sha256_digest()
+	: ctx_(EVP_MD_CTX_create())
+{
+	if (!ctx_ || !EVP_DigestInit_ex(ctx_, EVP_sha256(), nullptr))
+	{
+		EVP_MD_CTX_destroy(ctx_);
+		throw std::runtime_error("sha256 failed");
+	}
+}
+
+sha256_digest::~sha256_digest()
+{
+	EVP_MD_CTX_destroy(ctx_);
+}
+
+void sha256_digest::update(char const* data, size_t size)
+{
+	if (!EVP_DigestUpdate(ctx_, data, size))
+	{
+		throw std::runtime_error("sha256 failed");
+	}
+}
+
+std::string sha256_digest::finish()
+{
+	std::string result(EVP_MAX_MD_SIZE, 0);
+	unsigned int len = 0;
+	if (!EVP_DigestFinal_ex(ctx_, (unsigned char*)&result[0], &len))
+	{
+		throw std::runtime_error("sha256 failed");
+	}
+	result.resize(len);
+	return result;
+}
+
+char const* cipher_name(cipher_type type)
+{
+	switch (type)
+	{
+	case AES_128_GCM: return "aes-128-gcm";
+	case CHACHA20_POLY1305: return "chacha20-poly1305";
+	default: return "unknown";
+	}
+}
+
+cipher_type cipher_by_name(std::string const& name)
+{
+	for (cipher_type type : { AES_128_GCM, CHACHA20_POLY1305 })
+	{
+		if (name == cipher_name(type))
+		{
+			return type;
+		}
+	}
+	throw std::invalid_argument("unknown cipher " + name);
+}
+
+bool cipher_available(cipher_type type)
+{
+	return evp_cipher(type) != nullptr;
+}
+
+std::string cipher_key(cipher_type type, std::string const& key)
+{
+	assert(key.size() == KEY_LEN);
+	switch (type)
+	{
+	case AES_128_GCM:
+		return key;
+	case CHACHA20_POLY1305:
+		return hmac_sha256(key, "chacha20-poly1305", 17);
+	default:
+		throw std::invalid_argument("unknown cipher " + std::to_string(type));
+	}
+}
+
+void encrypt(cipher_type type, std::string const& key, std::string const& iv,
+	char* auth_tag, char const* data, size_t size, char* out)
+{
+	cipher_ctx ctx = new_cipher_ctx(type, true, key, iv);
+
+	int final_len = 0;
+	if (!cipher_update(ctx.get(), data, size, out)
+		|| !EVP_CipherFinal_ex(ctx.get(), (unsigned char*)out + size, &final_len)
+		|| !EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_GET_TAG, (int)TAG_LEN, auth_tag))
+	{
+		throw std::runtime_error("encryption failed");
+	}
+}
+
+void decrypt(cipher_type type, std::string const& key, std::string const& iv,
+	char const* auth_tag, char const* data, size_t size, char* out)
+{
+	cipher_ctx ctx = new_cipher_ctx(type, false, key, iv);
+
+	int final_len = 0;
+	if (!cipher_update(ctx.get(), data, size, out)
+		|| !EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_TAG, (int)TAG_LEN, const_cast<char*>(auth_tag))
+		|| !EVP_CipherFinal_ex(ctx.get(), (unsigned char*)out + size, &final_len))
+	{
+		throw std::runtime_error("decryption failed");
+	}
+}
+
+} // namespace crypto
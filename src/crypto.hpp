@@ -0,0 +1,78 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+struct evp_md_ctx_st;
+
+// Cryptographic primitives on top of OpenSSL, usable without Node.js
+namespace crypto {
+
+size_t const KEY_LEN = 128 / 8;
+size_t const IV_LEN = 96 / 8;
+size_t const TAG_LEN = 128 / 8;
+
+std::string random_bytes(size_t size);
+
+std::string pbkdf2(std::string const& password, std::string const& salt,
+	size_t iterations, size_t keylen);
+
+// SHA-256 digest of `size` bytes from `data`
+std::string sha256(char const* data, size_t size);
+
+// HMAC-SHA-256 of `size` bytes from `data` with `key`
+std::string hmac_sha256(std::string const& key, char const* data, size_t size);
+
+// SHA-256 digest of data added in parts
+class sha256_digest
+{
+public:
+	sha256_digest();
+	~sha256_digest();
+
+	sha256_digest(sha256_digest const&) = delete;
+	sha256_digest& operator=(sha256_digest const&) = delete;
+
+	void update(char const* data, size_t size);
+	std::string finish();
+
+private:
+	evp_md_ctx_st* ctx_;
+};
+
+// AEAD ciphers, the value is stored in the package header. ChaCha20-Poly1305
+// is faster than AES-GCM on CPUs without AES instructions
+enum cipher_type : uint8_t { AES_128_GCM = 0, CHACHA20_POLY1305 = 1 };
+
+char const* cipher_name(cipher_type type);
+
+// cipher by name as returned by cipher_name(), throws std::invalid_argument for unknown names
+cipher_type cipher_by_name(std::string const& name);
+
+// whether the cipher is supported by the OpenSSL version in use
+bool cipher_available(cipher_type type);
+
+// key for the cipher from a KEY_LEN bytes `key`, ChaCha20-Poly1305
+// uses a 256 bit key derived with HMAC-SHA-256
+std::string cipher_key(cipher_type type, std::string const& key);
+
+// encryption of `size` bytes from `data` into `out` with a key returned
+// by cipher_key(), `auth_tag` receives TAG_LEN bytes
+void encrypt(cipher_type type, std::string const& key, std::string const& iv,
+	char* auth_tag, char const* data, size_t size, char* out);
+
+// decryption of `size` bytes from `data` into `out` with a key returned
+// by cipher_key(), throws std::runtime_error on authentication failure
+void decrypt(cipher_type type, std::string const& key, std::string const& iv,
+	char const* auth_tag, char const* data, size_t size, char* out);
+
+} // namespace crypto
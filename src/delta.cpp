@@ -0,0 +1,281 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#include "delta.hpp"
+#include "binary_io.hpp"
+#include "crypto.hpp"
+#include "mapped_file.hpp"
+#include "path.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace delta {
+
+namespace {
+
+uint32_t const SIGN = 0x30444349; // ICD0
+
+// chunk sizes: minimal, maximal, and the boundary mask for 16 KiB on average after the minimum
+uint64_t const MIN_CHUNK = 8 * 1024;
+uint64_t const MAX_CHUNK = 128 * 1024;
+uint64_t const CHUNK_MASK = uint64_t(0x3FFF) << 50;
+
+enum op_type : uint8_t { COPY = 1, ADD = 2 };
+
+// random values for the gear rolling hash
+struct gear_table
+{
+	uint64_t values[256];
+
+	gear_table()
+	{
+		uint64_t x = 0x9e3779b97f4a7c15ULL;
+		for (uint64_t& value : values)
+		{
+			x += 0x9e3779b97f4a7c15ULL;
+			uint64_t z = x;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			value = z ^ (z >> 31);
+		}
+	}
+};
+
+gear_table const gear;
+
+class file_writer
+{
+public:
+	explicit file_writer(std::string const& filename)
+		: filename_(filename)
+		, file_(filename.c_str(), std::ios::binary | std::ios::trunc)
+	{
+		if (!file_.is_open())
+		{
+			throw std::runtime_error("can't open " + filename);
+		}
+	}
+
+	void write(char const* data, size_t size)
+	{
+		if (!file_.write(data, size))
+		{
+			throw std::runtime_error("can't write " + filename_);
+		}
+		digest_.update(data, size);
+		size_ += size;
+	}
+
+	// close the file and return SHA-256 of the written contents
+	std::string finish()
+	{
+		if (!file_.flush())
+		{
+			throw std::runtime_error("can't write " + filename_);
+		}
+		file_.close();
+		return digest_.finish();
+	}
+
+	uint64_t size() const { return size_; }
+
+private:
+	std::string filename_;
+	std::ofstream file_;
+	crypto::sha256_digest digest_;
+	uint64_t size_ = 0;
+};
+
+} // unnamed namespace
+
+std::vector<uint64_t> chunk_ends(char const* data, uint64_t size)
+{
+	std::vector<uint64_t> result;
+	uint64_t start = 0;
+	while (start < size)
+	{
+		uint64_t const left = size - start;
+		uint64_t end = start + std::min(left, MAX_CHUNK);
+		if (left > MIN_CHUNK)
+		{
+			uint64_t hash = 0;
+			for (uint64_t pos = start + MIN_CHUNK; pos < end; ++pos)
+			{
+				hash = (hash << 1) + gear.values[static_cast<unsigned char>(data[pos])];
+				if ((hash & CHUNK_MASK) == 0)
+				{
+					end = pos + 1;
+					break;
+				}
+			}
+		}
+		result.push_back(end);
+		start = end;
+	}
+	return result;
+}
+
+diff_result diff(std::string const& old_file, std::string const& new_file, std::string const& delta_file)
+{
+	if (path(delta_file).is_same_file(old_file) || path(delta_file).is_same_file(new_file))
+	{
+		throw std::invalid_argument("diff output should be a new file");
+	}
+
+	mapped_file const old_data(old_file);
+	mapped_file const new_data(new_file);
+
+	// old chunks by their hash, the first one of equal chunks
+	std::unordered_map<std::string, std::pair<uint64_t, uint64_t>> old_chunks;
+	uint64_t start = 0;
+	for (uint64_t end : chunk_ends(old_data.data(), old_data.size()))
+	{
+		old_chunks.emplace(crypto::sha256(old_data.data() + start, static_cast<size_t>(end - start)),
+			std::make_pair(start, end - start));
+		start = end;
+	}
+
+	std::string header;
+	binary_writer out(header);
+	out.write(SIGN);
+	out.write(static_cast<uint64_t>(old_data.size()));
+	out.write_bytes(crypto::sha256(old_data.data(), old_data.size()));
+	out.write(static_cast<uint64_t>(new_data.size()));
+	out.write_bytes(crypto::sha256(new_data.data(), new_data.size()));
+
+	file_writer delta(delta_file);
+	delta.write(header.data(), header.size());
+
+	diff_result result;
+	op_type op = COPY;
+	uint64_t op_offset = 0, op_length = 0;
+	auto const flush = [&]()
+	{
+		if (op_length == 0)
+		{
+			return;
+		}
+		std::string buf;
+		binary_writer op_out(buf);
+		op_out.write(static_cast<uint8_t>(op));
+		if (op == COPY)
+		{
+			op_out.write(op_offset);
+			op_out.write(op_length);
+			delta.write(buf.data(), buf.size());
+			result.copied += op_length;
+		}
+		else
+		{
+			op_out.write(op_length);
+			delta.write(buf.data(), buf.size());
+			delta.write(new_data.data() + op_offset, static_cast<size_t>(op_length));
+			result.added += op_length;
+		}
+		op_length = 0;
+	};
+
+	// adjacent operations of the same type are merged
+	start = 0;
+	for (uint64_t end : chunk_ends(new_data.data(), new_data.size()))
+	{
+		uint64_t const length = end - start;
+		auto const found = old_chunks.find(crypto::sha256(new_data.data() + start, static_cast<size_t>(length)));
+		if (found != old_chunks.end())
+		{
+			uint64_t const offset = found->second.first;
+			if (op != COPY || op_offset + op_length != offset)
+			{
+				flush();
+				op = COPY;
+				op_offset = offset;
+			}
+		}
+		else if (op != ADD)
+		{
+			flush();
+			op = ADD;
+			op_offset = start;
+		}
+		op_length += length;
+		start = end;
+	}
+	flush();
+	delta.finish();
+	result.size = delta.size();
+	return result;
+}
+
+void patch(std::string const& old_file, std::string const& delta_file, std::string const& new_file)
+{
+	if (path(new_file).is_same_file(old_file) || path(new_file).is_same_file(delta_file))
+	{
+		throw std::invalid_argument("patch output should be a new file");
+	}
+
+	mapped_file const old_data(old_file);
+	mapped_file const delta_data(delta_file);
+	binary_reader in(delta_data.data(), delta_data.size());
+	if (in.read<uint32_t>() != SIGN)
+	{
+		throw std::runtime_error(delta_file + " is not a package delta");
+	}
+	uint64_t const old_size = in.read<uint64_t>();
+	std::string const old_hash = in.read_string();
+	uint64_t const new_size = in.read<uint64_t>();
+	std::string const new_hash = in.read_string();
+	if (old_size != old_data.size() || old_hash != crypto::sha256(old_data.data(), old_data.size()))
+	{
+		throw std::runtime_error("delta " + delta_file + " is not made for " + old_file);
+	}
+
+	try
+	{
+		file_writer out(new_file);
+		while (in.left() > 0)
+		{
+			uint8_t const op = in.read<uint8_t>();
+			if (op == COPY)
+			{
+				uint64_t const offset = in.read<uint64_t>();
+				uint64_t const length = in.read<uint64_t>();
+				if (offset > old_data.size() || length > old_data.size() - offset)
+				{
+					throw std::runtime_error("delta " + delta_file + " is corrupted");
+				}
+				out.write(old_data.data() + offset, static_cast<size_t>(length));
+			}
+			else if (op == ADD)
+			{
+				string_ref const bytes = in.read_large_bytes();
+				out.write(bytes.data(), bytes.size());
+			}
+			else
+			{
+				throw std::runtime_error("delta " + delta_file + " is corrupted");
+			}
+		}
+		if (out.size() != new_size || out.finish() != new_hash)
+		{
+			throw std::runtime_error("delta " + delta_file + " result doesn't match");
+		}
+	}
+	catch (...)
+	{
+		std::remove(new_file.c_str());
+		throw;
+	}
+}
+
+} // namespace delta
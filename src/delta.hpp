@@ -0,0 +1,38 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary deltas between package files. Files are split into content-defined
+// chunks, chunks of the new file found in the old one are copied, others are
+// stored in the delta. Packages are encrypted deterministically, so unchanged
+// files give unchanged chunks and a delta doesn't need the auth key.
+namespace delta {
+
+// chunk ends in `size` bytes of `data`, a change moves only the nearby ends
+std::vector<uint64_t> chunk_ends(char const* data, uint64_t size);
+
+struct diff_result
+{
+	uint64_t size = 0;   // delta file size
+	uint64_t copied = 0; // bytes copied from the old file
+	uint64_t added = 0;  // bytes stored in the delta
+};
+
+// write delta from `old_file` to `new_file` into `delta_file`
+diff_result diff(std::string const& old_file, std::string const& new_file, std::string const& delta_file);
+
+// apply `delta_file` to `old_file` writing `new_file`, checks the old and the result contents
+void patch(std::string const& old_file, std::string const& delta_file, std::string const& new_file);
+
+} // namespace delta
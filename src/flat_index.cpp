@@ -0,0 +1,330 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#include "flat_index.hpp"
+#include "binary_io.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+uint64_t mix(uint64_t x)
+{
+	x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+uint64_t key_hash(string_ref key, uint64_t seed)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (char ch : key)
+	{
+		h = (h ^ static_cast<unsigned char>(ch)) * 0x100000001b3ULL;
+	}
+	return mix(h ^ seed);
+}
+
+uint32_t bucket_of(uint64_t hash, uint32_t bucket_count)
+{
+	return static_cast<uint32_t>((hash >> 32) % bucket_count);
+}
+
+uint64_t position(uint64_t hash, uint32_t pilot, uint64_t count)
+{
+	return mix(hash ^ ((pilot + 1ULL) * 0x9e3779b97f4a7c15ULL)) % count;
+}
+
+template<typename T>
+T load(char const* ptr, size_t index)
+{
+	T result;
+	memcpy(&result, ptr + index * sizeof(T), sizeof(T));
+	return result;
+}
+
+void write_varint(std::string& out, uint64_t value)
+{
+	for (; value >= 0x80; value >>= 7)
+	{
+		out += static_cast<char>(value | 0x80);
+	}
+	out += static_cast<char>(value);
+}
+
+uint64_t read_varint(string_ref data, size_t& pos)
+{
+	uint64_t result = 0;
+	for (unsigned shift = 0; shift < 64; shift += 7)
+	{
+		if (pos >= data.size())
+		{
+			break;
+		}
+		unsigned char const byte = data.data()[pos++];
+		result |= uint64_t(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return result;
+		}
+	}
+	throw std::runtime_error("Package invalid format");
+}
+
+} // unnamed namespace
+
+std::string flat_index::build(std::vector<std::pair<std::string, entry>> entries)
+{
+	std::sort(entries.begin(), entries.end(),
+		[](std::pair<std::string, entry> const& lhs, std::pair<std::string, entry> const& rhs)
+		{ return lhs.first < rhs.first; });
+	for (size_t i = 1; i < entries.size(); ++i)
+	{
+		if (entries[i - 1].first == entries[i].first)
+		{
+			throw std::invalid_argument("duplicate index key " + entries[i].first);
+		}
+	}
+	if (entries.size() > UINT32_MAX)
+	{
+		throw std::runtime_error("Package write error: too many files");
+	}
+
+	uint64_t const count = entries.size();
+	uint32_t const bucket_count = static_cast<uint32_t>(count / 4 + 1);
+	std::vector<uint32_t> pilots(bucket_count), slots(count);
+
+	// hash and displace: place larger buckets first, find for each bucket
+	// a pilot value moving all its keys to free positions
+	uint64_t seed = 0;
+	for (bool placed = (count == 0); !placed; )
+	{
+		++seed;
+		std::vector<uint64_t> hashes(count);
+		std::vector<std::vector<uint32_t>> buckets(bucket_count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			hashes[i] = key_hash(entries[i].first, seed);
+			buckets[bucket_of(hashes[i], bucket_count)].push_back(i);
+		}
+		std::vector<uint32_t> order(bucket_count);
+		for (uint32_t b = 0; b < bucket_count; ++b) order[b] = b;
+		std::stable_sort(order.begin(), order.end(),
+			[&buckets](uint32_t lhs, uint32_t rhs) { return buckets[lhs].size() > buckets[rhs].size(); });
+
+		std::vector<bool> taken(count);
+		std::vector<uint64_t> positions;
+		uint64_t const max_pilot = 64 + 32 * count;
+		placed = true;
+		for (uint32_t b : order)
+		{
+			std::vector<uint32_t> const& bucket = buckets[b];
+			if (bucket.empty()) break;
+
+			bool found = false;
+			for (uint64_t pilot = 0; pilot < max_pilot && pilot <= UINT32_MAX && !found; ++pilot)
+			{
+				positions.clear();
+				found = true;
+				for (uint32_t i : bucket)
+				{
+					uint64_t const pos = position(hashes[i], static_cast<uint32_t>(pilot), count);
+					if (taken[pos] || std::find(positions.begin(), positions.end(), pos) != positions.end())
+					{
+						found = false;
+						break;
+					}
+					positions.push_back(pos);
+				}
+				if (found)
+				{
+					pilots[b] = static_cast<uint32_t>(pilot);
+					for (size_t k = 0; k < bucket.size(); ++k)
+					{
+						taken[positions[k]] = true;
+						slots[positions[k]] = bucket[k];
+					}
+				}
+			}
+			if (!found)
+			{
+				placed = false;
+				break;
+			}
+		}
+	}
+
+	// keys are front-coded in groups, the first key of a group is stored whole
+	std::string keys;
+	std::vector<uint64_t> groups;
+	for (size_t i = 0; i < count; ++i)
+	{
+		std::string const& key = entries[i].first;
+		size_t shared = 0;
+		if (i % GROUP_SIZE == 0)
+		{
+			groups.push_back(keys.size());
+		}
+		else
+		{
+			std::string const& prev = entries[i - 1].first;
+			size_t const max_shared = std::min(prev.size(), key.size());
+			while (shared < max_shared && prev[shared] == key[shared]) ++shared;
+		}
+		write_varint(keys, shared);
+		write_varint(keys, key.size() - shared);
+		keys.append(key, shared, std::string::npos);
+	}
+
+	std::string result;
+	binary_writer out(result);
+	out.write(count);
+	out.write(bucket_count);
+	out.write(static_cast<uint32_t>(GROUP_SIZE));
+	out.write(seed);
+	for (uint32_t pilot : pilots) out.write(pilot);
+	for (uint32_t slot : slots) out.write(slot);
+	for (auto const& e : entries)
+	{
+		out.write(e.second.offset);
+		out.write(e.second.size);
+	}
+	for (uint64_t group : groups) out.write(group);
+	out.write(static_cast<uint64_t>(keys.size()));
+	result += keys;
+	return result;
+}
+
+flat_index::flat_index(string_ref data)
+{
+	binary_reader in(data.data(), data.size());
+	count_ = in.read<uint64_t>();
+	bucket_count_ = in.read<uint32_t>();
+	uint32_t const group_size = in.read<uint32_t>();
+	seed_ = in.read<uint64_t>();
+	if (group_size != GROUP_SIZE || bucket_count_ == 0 || count_ > in.left() / sizeof(entry))
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	size_t const count = static_cast<size_t>(count_);
+	pilots_ = in.take(bucket_count_ * sizeof(uint32_t));
+	slots_ = in.take(count * sizeof(uint32_t));
+	entries_ = in.take(count * sizeof(entry));
+	groups_ = in.take((count + GROUP_SIZE - 1) / GROUP_SIZE * sizeof(uint64_t));
+	uint64_t const keys_size = in.read<uint64_t>();
+	if (keys_size > in.left())
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	keys_ = string_ref(in.take(static_cast<size_t>(keys_size)), static_cast<size_t>(keys_size));
+}
+
+void flat_index::decode(size_t i, std::string& key) const
+{
+	size_t const group = i / GROUP_SIZE;
+	size_t pos = group_start(group);
+	key.clear();
+	for (size_t j = group * GROUP_SIZE; j <= i; ++j)
+	{
+		next_key(pos, key);
+	}
+}
+
+size_t flat_index::group_start(size_t group) const
+{
+	uint64_t const group_pos = load<uint64_t>(groups_, group);
+	if (group_pos > keys_.size())
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	return static_cast<size_t>(group_pos);
+}
+
+void flat_index::next_key(size_t& pos, std::string& key) const
+{
+	uint64_t const shared = read_varint(keys_, pos);
+	uint64_t const len = read_varint(keys_, pos);
+	if (shared > key.size() || len > keys_.size() - pos)
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	key.resize(static_cast<size_t>(shared));
+	key.append(keys_.data() + pos, static_cast<size_t>(len));
+	pos += static_cast<size_t>(len);
+}
+
+bool flat_index::find(string_ref key, entry& result) const
+{
+	if (count_ == 0)
+	{
+		return false;
+	}
+	uint64_t const hash = key_hash(key, seed_);
+	uint32_t const pilot = load<uint32_t>(pilots_, bucket_of(hash, bucket_count_));
+	uint32_t const i = load<uint32_t>(slots_, static_cast<size_t>(position(hash, pilot, count_)));
+	if (i >= count_)
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+
+	// a key not in the index is mapped to some entry too
+	thread_local std::string stored;
+	decode(i, stored);
+	if (string_ref(stored) != key)
+	{
+		return false;
+	}
+	result = value(i);
+	return true;
+}
+
+std::string flat_index::key(size_t i) const
+{
+	std::string result;
+	decode(i, result);
+	return result;
+}
+
+std::vector<std::string> flat_index::keys(size_t first, size_t last) const
+{
+	last = std::min(last, size());
+	std::vector<std::string> result;
+	if (first >= last)
+	{
+		return result;
+	}
+	result.reserve(last - first);
+
+	// decode the group of `first` from its start, following keys in sequence
+	std::string key;
+	size_t pos = group_start(first / GROUP_SIZE);
+	for (size_t i = first / GROUP_SIZE * GROUP_SIZE; i < last; ++i)
+	{
+		if (i % GROUP_SIZE == 0)
+		{
+			key.clear();
+		}
+		next_key(pos, key);
+		if (i >= first)
+		{
+			result.push_back(key);
+		}
+	}
+	return result;
+}
+
+flat_index::entry flat_index::value(size_t i) const
+{
+	entry result;
+	result.offset = load<uint64_t>(entries_, 2 * i);
+	result.size = load<uint64_t>(entries_, 2 * i + 1);
+	return result;
+}
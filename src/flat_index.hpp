@@ -0,0 +1,70 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "string_ref.hpp"
+
+// Sorted table of keys with 64-bit offset and size values, used in place
+// in package memory. Keys are front-coded in groups, a minimal perfect hash
+// table maps a key to its entry, so a lookup decodes at most one group.
+class flat_index
+{
+public:
+	struct entry
+	{
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	// serialized index of `entries`, keys should be unique
+	static std::string build(std::vector<std::pair<std::string, entry>> entries);
+
+	flat_index()
+		: count_(0), bucket_count_(0), seed_(0)
+		, pilots_(nullptr), slots_(nullptr), entries_(nullptr), groups_(nullptr)
+	{
+	}
+
+	// index in `data`, which should outlive it; checks only the table sizes
+	explicit flat_index(string_ref data);
+
+	size_t size() const { return static_cast<size_t>(count_); }
+	bool empty() const { return count_ == 0; }
+
+	bool find(string_ref key, entry& result) const;
+
+	// key and value of entry `i` in sorted order
+	std::string key(size_t i) const;
+	entry value(size_t i) const;
+
+	// keys of entries [first, last) in sorted order
+	std::vector<std::string> keys(size_t first, size_t last) const;
+
+private:
+	static size_t const GROUP_SIZE = 16;
+
+	void decode(size_t i, std::string& key) const;
+	size_t group_start(size_t group) const;
+	void next_key(size_t& pos, std::string& key) const;
+
+	uint64_t count_;
+	uint32_t bucket_count_;
+	uint64_t seed_;
+	char const* pilots_;  // uint32_t per bucket
+	char const* slots_;   // uint32_t entry index per hash position
+	char const* entries_; // offset and size per entry
+	char const* groups_;  // uint64_t position in keys_ per group
+	string_ref keys_;
+};
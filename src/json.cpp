@@ -0,0 +1,207 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#include "json.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace json {
+
+class parser
+{
+public:
+	explicit parser(std::string const& text)
+		: cur_(text.data())
+		, end_(text.data() + text.size())
+	{
+	}
+
+	value parse_document()
+	{
+		value result = parse_value();
+		skip_space();
+		if (cur_ != end_) error("unexpected trailing data");
+		return result;
+	}
+
+private:
+	char const* cur_;
+	char const* end_;
+
+	[[noreturn]] void error(char const* what)
+	{
+		throw std::runtime_error(std::string("JSON parse error: ") + what);
+	}
+
+	void skip_space()
+	{
+		while (cur_ != end_ && (*cur_ == ' ' || *cur_ == '\t' || *cur_ == '\r' || *cur_ == '\n')) ++cur_;
+	}
+
+	bool skip_literal(char const* literal)
+	{
+		size_t const len = strlen(literal);
+		if (size_t(end_ - cur_) >= len && strncmp(cur_, literal, len) == 0)
+		{
+			cur_ += len;
+			return true;
+		}
+		return false;
+	}
+
+	void expect(char ch)
+	{
+		skip_space();
+		if (cur_ == end_ || *cur_ != ch) error("unexpected character");
+		++cur_;
+	}
+
+	value parse_value()
+	{
+		skip_space();
+		if (cur_ == end_) error("unexpected end of data");
+
+		value result;
+		switch (*cur_)
+		{
+		case '{':
+			result.type_ = value::object;
+			++cur_;
+			skip_space();
+			if (cur_ != end_ && *cur_ == '}') { ++cur_; break; }
+			for (;;)
+			{
+				skip_space();
+				if (cur_ == end_ || *cur_ != '"') error("expected object member name");
+				std::string name = parse_string();
+				expect(':');
+				result.object_[name] = parse_value();
+				skip_space();
+				if (cur_ != end_ && *cur_ == ',') { ++cur_; continue; }
+				expect('}');
+				break;
+			}
+			break;
+		case '[':
+			result.type_ = value::array;
+			++cur_;
+			skip_space();
+			if (cur_ != end_ && *cur_ == ']') { ++cur_; break; }
+			for (;;)
+			{
+				result.array_.emplace_back(parse_value());
+				skip_space();
+				if (cur_ != end_ && *cur_ == ',') { ++cur_; continue; }
+				expect(']');
+				break;
+			}
+			break;
+		case '"':
+			result.type_ = value::string;
+			result.string_ = parse_string();
+			break;
+		default:
+			if (skip_literal("null")) break;
+			if (skip_literal("true")) { result.type_ = value::boolean; result.bool_ = true; break; }
+			if (skip_literal("false")) { result.type_ = value::boolean; result.bool_ = false; break; }
+			{
+				char const* const num_begin = cur_;
+				while (cur_ != end_ && strchr("+-.eE0123456789", *cur_)) ++cur_;
+				std::string const num(num_begin, cur_);
+				char* num_end = nullptr;
+				result.number_ = strtod(num.c_str(), &num_end);
+				if (num.empty() || num_end != num.c_str() + num.size()) error("unexpected character");
+				result.type_ = value::number;
+			}
+			break;
+		}
+		return result;
+	}
+
+	static void append_utf8(std::string& str, unsigned long cp)
+	{
+		if (cp < 0x80) str += char(cp);
+		else if (cp < 0x800) { str += char(0xC0 | (cp >> 6)); str += char(0x80 | (cp & 0x3F)); }
+		else if (cp < 0x10000) { str += char(0xE0 | (cp >> 12)); str += char(0x80 | ((cp >> 6) & 0x3F)); str += char(0x80 | (cp & 0x3F)); }
+		else { str += char(0xF0 | (cp >> 18)); str += char(0x80 | ((cp >> 12) & 0x3F)); str += char(0x80 | ((cp >> 6) & 0x3F)); str += char(0x80 | (cp & 0x3F)); }
+	}
+
+	unsigned long parse_hex4()
+	{
+		if (end_ - cur_ < 4) error("invalid unicode escape");
+		std::string const hex(cur_, 4);
+		char* hex_end = nullptr;
+		unsigned long const cp = strtoul(hex.c_str(), &hex_end, 16);
+		if (hex_end != hex.c_str() + 4) error("invalid unicode escape");
+		cur_ += 4;
+		return cp;
+	}
+
+	std::string parse_string()
+	{
+		++cur_; // opening quote
+		std::string result;
+		while (cur_ != end_ && *cur_ != '"')
+		{
+			char ch = *cur_++;
+			if (ch != '\\')
+			{
+				result += ch;
+				continue;
+			}
+			if (cur_ == end_) break;
+			switch (ch = *cur_++)
+			{
+			case 'b': result += '\b'; break;
+			case 'f': result += '\f'; break;
+			case 'n': result += '\n'; break;
+			case 'r': result += '\r'; break;
+			case 't': result += '\t'; break;
+			case 'u':
+				{
+					unsigned long cp = parse_hex4();
+					if (cp >= 0xD800 && cp < 0xDC00 && skip_literal("\\u"))
+					{
+						cp = 0x10000 + ((cp - 0xD800) << 10) + (parse_hex4() - 0xDC00);
+					}
+					append_utf8(result, cp);
+				}
+				break;
+			default: result += ch; break;
+			}
+		}
+		if (cur_ == end_) error("unterminated string");
+		++cur_; // closing quote
+		return result;
+	}
+};
+
+value const& value::operator[](std::string const& name) const
+{
+	static value const none;
+	auto const it = object_.find(name);
+	return it != object_.end()? it->second : none;
+}
+
+bool value::get(std::string const& name, std::string& result) const
+{
+	value const& member = (*this)[name];
+	if (!member.is(string)) return false;
+	result = member.as_string();
+	return true;
+}
+
+value parse(std::string const& text)
+{
+	return parser(text).parse_document();
+}
+
+} // namespace json
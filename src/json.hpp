@@ -0,0 +1,60 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Minimal JSON reader for package.json files and build manifests,
+// so packages can be built without V8
+namespace json {
+
+class value
+{
+public:
+	enum type_t { null, boolean, number, string, array, object };
+
+	using array_t = std::vector<value>;
+	using object_t = std::map<std::string, value>;
+
+	value() : type_(null), bool_(false), number_(0) {}
+
+	type_t type() const { return type_; }
+	bool is(type_t type) const { return type_ == type; }
+
+	bool as_bool() const { return bool_; }
+	double as_number() const { return number_; }
+	std::string const& as_string() const { return string_; }
+	array_t const& as_array() const { return array_; }
+	object_t const& as_object() const { return object_; }
+
+	// object member, null value if there is no such a member
+	value const& operator[](std::string const& name) const;
+
+	// get string member value into `result`, return false if no such a string member
+	bool get(std::string const& name, std::string& result) const;
+
+	friend value parse(std::string const& text);
+private:
+	friend class parser;
+
+	type_t type_;
+	bool bool_;
+	double number_;
+	std::string string_;
+	array_t array_;
+	object_t object_;
+};
+
+// parse JSON text, throws std::runtime_error on syntax error
+value parse(std::string const& text);
+
+} // namespace json
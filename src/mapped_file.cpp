@@ -0,0 +1,137 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#include "mapped_file.hpp"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#define open _open
+#define close _close
+#define fstat _fstati64
+#define stat _stati64
+#define O_RDONLY (_O_RDONLY | _O_BINARY)
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+mapped_file::mapped_file(std::string const& filename)
+	: base_(nullptr)
+	, base_size_(0)
+	, data_(nullptr)
+	, size_(0)
+{
+	int const fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		throw std::runtime_error("can't open " + filename);
+	}
+	try
+	{
+		map(fd, 0, npos);
+	}
+	catch (...)
+	{
+		close(fd);
+		throw;
+	}
+	close(fd);
+}
+
+mapped_file::mapped_file(int fd, uint64_t offset, uint64_t length)
+	: base_(nullptr)
+	, base_size_(0)
+	, data_(nullptr)
+	, size_(0)
+{
+	map(fd, offset, length);
+}
+
+mapped_file::~mapped_file()
+{
+	if (base_)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(base_);
+#else
+		munmap(base_, base_size_);
+#endif
+	}
+}
+
+void mapped_file::map(int fd, uint64_t offset, uint64_t length)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		throw std::runtime_error("can't stat file descriptor " + std::to_string(fd));
+	}
+	uint64_t const file_size = st.st_size;
+	if (offset > file_size || (length != npos && length > file_size - offset))
+	{
+		throw std::runtime_error("file region is out of file size");
+	}
+	if (length == npos)
+	{
+		length = file_size - offset;
+	}
+	if (length != size_t(length))
+	{
+		throw std::runtime_error("file region is too large to map");
+	}
+	size_ = length;
+	if (size_ == 0)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	// view offset should be aligned to allocation granularity
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	uint64_t const base_offset = offset - offset % info.dwAllocationGranularity;
+	base_size_ = size_ + (offset - base_offset);
+	HANDLE const mapping = CreateFileMappingW(reinterpret_cast<HANDLE>(_get_osfhandle(fd)),
+		nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		throw std::runtime_error("can't map file descriptor " + std::to_string(fd));
+	}
+	// the view keeps the mapping object
+	base_ = MapViewOfFile(mapping, FILE_MAP_READ,
+		static_cast<DWORD>(base_offset >> 32), static_cast<DWORD>(base_offset), base_size_);
+	CloseHandle(mapping);
+	if (!base_)
+	{
+		throw std::runtime_error("can't map file descriptor " + std::to_string(fd));
+	}
+	data_ = static_cast<char const*>(base_) + (offset - base_offset);
+#else
+	// mmap offset should be aligned to page size
+	uint64_t const page_size = sysconf(_SC_PAGESIZE);
+	uint64_t const base_offset = offset - offset % page_size;
+	base_size_ = size_ + (offset - base_offset);
+	base_ = mmap(nullptr, base_size_, PROT_READ, MAP_SHARED, fd, base_offset);
+	if (base_ == MAP_FAILED)
+	{
+		base_ = nullptr;
+		throw std::runtime_error("can't map file descriptor " + std::to_string(fd));
+	}
+	data_ = static_cast<char const*>(base_) + (offset - base_offset);
+#endif
+}
@@ -0,0 +1,44 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapped view of a file region, pages are read on access,
+// so the region may be larger than physical memory
+class mapped_file
+{
+public:
+	static uint64_t const npos = ~uint64_t(0);
+
+	// map whole file
+	explicit mapped_file(std::string const& filename);
+
+	// map `length` bytes at `offset` in open file descriptor `fd`,
+	// up to the end of file if length is npos
+	mapped_file(int fd, uint64_t offset, uint64_t length = npos);
+
+	~mapped_file();
+
+	mapped_file(mapped_file const&) = delete;
+	mapped_file& operator=(mapped_file const&) = delete;
+
+	char const* data() const { return data_; }
+	size_t size() const { return size_; }
+
+private:
+	void map(int fd, uint64_t offset, uint64_t length);
+
+	void* base_;
+	size_t base_size_;
+	char const* data_;
+	size_t size_;
+};
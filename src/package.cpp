@@ -8,11 +8,31 @@
 // file LICENSE
 //
 #include "package.hpp"
-#include "base32.hpp"
+#include "arena.hpp"
+#include "auth.hpp"
+#include "binary_io.hpp"
+#include "delta.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iterator>
-#include <numeric>
+#include <map>
+#include <sstream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #pragma warning(push, 3)
 #include <node_buffer.h>
@@ -20,452 +40,1556 @@
 #include <v8pp/class.hpp>
 #include <v8pp/object.hpp>
 #include <v8pp/call_v8.hpp>
-
-#include <yas/binary_iarchive.hpp>
-#include <yas/binary_oarchive.hpp>
-#include <yas/mem_streams.hpp>
-#include <yas/file_streams.hpp>
-#include <yas/serializers/std_types_serializers.hpp>
 #pragma warning(pop)
 
-static uint32_t const SIGN = 0x30504349; // ICP0
-
-v8::UniquePersistent<v8::Object> package::node_module;
-v8::UniquePersistent<v8::Function> package::node_require;
-v8::UniquePersistent<v8::Object> package::node_crypto;
-
-static std::string pbkdf2(v8::Isolate* isolate, std::string const& password, std::string const& salt,
-	size_t iterations, size_t keylen, char const* digest = "sha256")
-{
-	v8::HandleScope scope(isolate);
-
-	v8::Local<v8::Object> crypto = v8pp::to_local(isolate, package::node_crypto);
+namespace {
 
-	v8::Local<v8::Function> fun;
-	v8pp::get_option(isolate, crypto, "pbkdf2Sync", fun);
+std::mutex states_mutex;
+std::unordered_map<v8::Isolate*, std::unique_ptr<package::isolate_state>> states;
 
-	v8::Local<v8::Value> buf = v8pp::call_v8(isolate, fun, crypto, password, salt, iterations, keylen, digest);
+// package contents shared with share() for attach() in other isolates
+std::mutex shared_mutex;
+std::unordered_map<uint32_t, std::weak_ptr<archive const>> shared_archives;
+uint32_t shared_next_id = 1;
 
-	return std::string(node::Buffer::Data(buf), node::Buffer::Length(buf));
-}
-
-static std::string random_bytes(v8::Isolate* isolate, size_t size)
+// Loaded package files, to reuse decrypted contents while any package
+// object refers to them. Keyed by file identity, size, modification time
+// and auth key fingerprint.
+class archive_cache
 {
-	v8::HandleScope scope(isolate);
+public:
+	std::shared_ptr<archive const> find(std::string const& key)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto const it = items_.find(key);
+		return it != items_.end()? it->second.lock() : nullptr;
+	}
 
-	v8::Local<v8::Object> crypto = v8pp::to_local(isolate, package::node_crypto);
+	std::shared_ptr<archive const> insert(std::string const& key, archive&& ar)
+	{
+		std::shared_ptr<archive const> result = std::make_shared<archive const>(std::move(ar));
+		if (!key.empty())
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			for (auto it = items_.begin(); it != items_.end(); )
+			{
+				if (it->second.expired()) it = items_.erase(it);
+				else ++it;
+			}
+			items_[key] = result;
+		}
+		return result;
+	}
+private:
+	std::mutex mutex_;
+	std::unordered_map<std::string, std::weak_ptr<archive const>> items_;
+};
 
-	v8::Local<v8::Function> fun;
-	v8pp::get_option(isolate, crypto, "randomBytes", fun);
+archive_cache load_cache;
 
-	v8::Local<v8::Value> buf = v8pp::call_v8(isolate, fun, crypto, size);
+// packages of an isolate using each archive, its memory is reported to V8 once
+std::mutex memory_users_mutex;
+std::map<std::pair<v8::Isolate*, archive const*>, uint32_t> memory_users;
 
-	return std::string(node::Buffer::Data(buf), node::Buffer::Length(buf));
-}
+#ifdef _WIN32
+using file_status = struct _stati64;
+int get_status(int fd, file_status& st) { return _fstati64(fd, &st); }
+int get_status(std::string const& filename, file_status& st) { return _stati64(filename.c_str(), &st); }
+void close_file(int fd) { _close(fd); }
+#else
+using file_status = struct stat;
+int get_status(int fd, file_status& st) { return fstat(fd, &st); }
+int get_status(std::string const& filename, file_status& st) { return ::stat(filename.c_str(), &st); }
+void close_file(int fd) { ::close(fd); }
+#endif
 
-static v8::Local<v8::Value> use_buffer(v8::Isolate* isolate, char const* data, size_t size)
+std::string cache_key(file_status const& st, auth_data const& auth, uint64_t offset, uint64_t length)
 {
-#if NODE_MAJOR_VERSION < 3
-	return node::Buffer::New(isolate, data, size);
-#else
-	// MaybeLocal has appeared in io.js version 3.0.0
-	return node::Buffer::New(isolate, const_cast<char*>(data), size,
-		[](char* data, void* hint){}, nullptr).ToLocalChecked();
+	std::string result;
+	binary_writer out(result);
+	out.write<uint64_t>(st.st_dev);
+	out.write<uint64_t>(st.st_ino);
+	out.write<uint64_t>(st.st_size);
+	out.write<uint64_t>(st.st_mtime);
+#ifdef __linux__
+	out.write<uint64_t>(st.st_mtim.tv_nsec);
 #endif
+	out.write(offset);
+	out.write(length);
+	std::string const key = auth.priv_key();
+	result += crypto::sha256(key.data(), key.size());
+	return result;
 }
 
-static yas::shared_buffer do_crypt(v8::Isolate* isolate, char const* name, bool encrypt,
-	std::string const& key, std::string const& iv,
-	yas::shared_buffer* auth_tag, char const* data, size_t size)
+} // unnamed namespace
+
+// Add duration of the scope to a stats total and to a module timing,
+// the clock is not read when stats are disabled
+class package::stats_timer
 {
-	char const* const create_name = (encrypt ? "createCipheriv" : "createDecipheriv");
+public:
+	stats_timer(stats_data& stats, uint64_t& total, path const& file = path(),
+			uint64_t module_stats::* module_total = nullptr)
+		: total_(stats.enabled? &total : nullptr)
+		, module_total_(stats.enabled && module_total? &(stats.modules[file].*module_total) : nullptr)
+		, start_(stats.enabled? monotonic_ns() : 0)
+	{
+	}
 
-	v8::HandleScope scope(isolate);
+	~stats_timer()
+	{
+		if (total_)
+		{
+			uint64_t const duration = monotonic_ns() - start_;
+			*total_ += duration;
+			if (module_total_) *module_total_ += duration;
+		}
+	}
 
-	v8::Local<v8::Object> crypto = v8pp::to_local(isolate, package::node_crypto);
+	stats_timer(stats_timer const&) = delete;
+	stats_timer& operator=(stats_timer const&) = delete;
+private:
+	uint64_t* total_;
+	uint64_t* module_total_;
+	uint64_t start_;
+};
 
-	v8::Local<v8::Function> create;
-	v8pp::get_option(isolate, crypto, create_name, create);
+package::isolate_state& package::init_state(v8::Isolate* isolate)
+{
+	std::lock_guard<std::mutex> lock(states_mutex);
+	std::unique_ptr<isolate_state>& result = states[isolate];
+	if (!result)
+	{
+		result.reset(new isolate_state);
+	}
+	return *result;
+}
 
-	v8::Local<v8::Object> cipher = v8pp::call_v8(isolate, create, crypto, name,
-		use_buffer(isolate, key.data(), key.size()), use_buffer(isolate, iv.data(), iv.size())).As<v8::Object>();
-	if (!encrypt && auth_tag)
+package::isolate_state& package::state(v8::Isolate* isolate)
+{
+	std::lock_guard<std::mutex> lock(states_mutex);
+	auto const it = states.find(isolate);
+	if (it == states.end())
 	{
-		v8::Local<v8::Function> set_auth_tag;
-		v8pp::get_option(isolate, cipher, "setAuthTag", set_auth_tag);
-		v8pp::call_v8(isolate, set_auth_tag, cipher, use_buffer(isolate, auth_tag->data.get(), auth_tag->size));
+		throw std::runtime_error("iris-crypt addon is not initialized in this isolate");
 	}
-	v8::Local<v8::Function> update, final;
-	v8pp::get_option(isolate, cipher, "update", update);
-	v8pp::get_option(isolate, cipher, "final", final);
+	return *it->second;
+}
 
-	v8::Local<v8::Value> buf1 = v8pp::call_v8(isolate, update, cipher, use_buffer(isolate, data, size));
-	v8::Local<v8::Value> buf2 = v8pp::call_v8(isolate, final, cipher);
-	if (buf1.IsEmpty() || buf2.IsEmpty())
+// unmap the memory kept for reuse by later loads when no archive uses the arena
+static void release_arena()
+{
+	if (arena::in_use() == 0)
 	{
-		throw std::runtime_error(encrypt? "encryption failed" : "decryption failed");
+		arena::trim();
 	}
+}
 
-	if (encrypt && auth_tag)
+void package::release_state(v8::Isolate* isolate)
+{
 	{
-		v8::Local<v8::Function> get_auth_tag;
-		v8pp::get_option(isolate, cipher, "getAuthTag", get_auth_tag);
-		v8::Local<v8::Value> tag_buf = v8pp::call_v8(isolate, get_auth_tag, cipher);
-		auth_tag->assign(node::Buffer::Data(tag_buf), node::Buffer::Length(tag_buf));
+		std::lock_guard<std::mutex> lock(states_mutex);
+		states.erase(isolate);
 	}
-	char const* const buf1_data = node::Buffer::Data(buf1);
-	char const* const buf2_data = node::Buffer::Data(buf2);
-	size_t const buf1_size = node::Buffer::Length(buf1);
-	size_t const buf2_size = node::Buffer::Length(buf2);
+	release_arena();
+}
+
+void package::gen_auth(v8::FunctionCallbackInfo<v8::Value> const& args)
+{
+	v8::Isolate* isolate = args.GetIsolate();
 
-	yas::shared_buffer result(buf1_size + buf2_size);
-	std::copy(buf1_data, buf1_data + buf1_size, result.data.get());
-	std::copy(buf2_data, buf2_data + buf2_size, result.data.get() + buf1_size);
+	std::string const password = v8pp::from_v8<std::string>(isolate, args[0]);
+	uint16_t const serial = v8pp::from_v8<uint16_t>(isolate, args[1]);
 
-	return result;
+	auth_data const auth(password, serial);
+
+	args.GetReturnValue().Set(v8pp::to_v8(isolate, auth.to_string()));
 }
 
-static yas::shared_buffer encrypt(v8::Isolate* isolate, std::string const& key, std::string& iv,
-	yas::shared_buffer& auth_tag, char const* data, size_t size)
+// file content from a string or a Buffer value
+static std::string content_from_v8(v8::Isolate* isolate, v8::Local<v8::Value> value)
 {
-	assert(key.size() == 128 / 8);
-	iv = random_bytes(isolate, 96 / 8);
-	return do_crypt(isolate, "aes-128-gcm", true, key, iv, &auth_tag, data, size);
+	if (node::Buffer::HasInstance(value))
+	{
+		return std::string(node::Buffer::Data(value), node::Buffer::Length(value));
+	}
+	return v8pp::from_v8<std::string>(isolate, value);
 }
 
-static yas::shared_buffer decrypt(v8::Isolate* isolate, std::string const& key, std::string const& iv,
-	yas::shared_buffer& auth_tag, char const* data, size_t size)
+// wipe and free decrypted source
+static void drop_plaintext(std::string& source)
 {
-	assert(key.size() == 128 / 8);
-	assert(iv.size() == 96 / 8);
-	return do_crypt(isolate, "aes-128-gcm", false, key, iv, &auth_tag, data, size);
+	std::fill(source.begin(), source.end(), 0);
+	std::string().swap(source);
 }
 
-// Auth key like XXXX-XXXX-XXXX-XXXX-XXXX-XXXX-YYYY-ZZZZ
-class auth_data
+// Node.js Buffer owning the string data
+static v8::Local<v8::Object> string_buffer(v8::Isolate* isolate, std::string&& str)
 {
-	// result string is in Base32, so binary data should be
-	// a multipler for 40 bit block.
-	static size_t const KEY_LEN = 16;
-	static size_t const AUTH_LEN = KEY_LEN + sizeof(uint16_t) * 2; // + serial + checksum
-	std::string data_;
-public:
-	auth_data(v8::Isolate* isolate, std::string const& password, uint16_t serial_number)
+	std::string* const data = new std::string(std::move(str));
+	auto free_string = [](char*, void* hint) { delete static_cast<std::string*>(hint); };
+#if NODE_MAJOR_VERSION < 3
+	return node::Buffer::New(isolate, &(*data)[0], data->size(), free_string, data);
+#else
+	// MaybeLocal has appeared in io.js version 3.0.0
+	return node::Buffer::New(isolate, &(*data)[0], data->size(), free_string, data).ToLocalChecked();
+#endif
+}
+
+void package::make(v8::FunctionCallbackInfo<v8::Value> const& args)
+{
+	v8::Isolate* isolate = args.GetIsolate();
+	v8::HandleScope scope(isolate);
+
+	auth_data const auth(v8pp::from_v8<std::string>(isolate, args[0]));
+	if (!args[2]->IsObject())
 	{
-		std::string const salt((char*)&serial_number, sizeof(serial_number));
-		// XXXX
-		data_ = pbkdf2(isolate, password, salt, 1000, KEY_LEN);
-		// YYYY
-		data_.append(salt);
-		// ZZZZ
-		uint16_t const checksum = std::accumulate(data_.begin(), data_.end(), uint16_t{});
-		data_.append((char*)&checksum, sizeof(checksum));
+		throw std::invalid_argument("expected files object");
 	}
+	v8::Local<v8::Object> files = args[2].As<v8::Object>();
 
-	explicit auth_data(std::string str)
+	archive ar;
+	bool bytecode = false;
+	if (args[3]->IsObject())
 	{
-		str.erase(std::remove(str.begin(), str.end(), '-'), str.end());
-		try { data_ = base32::decode<base32::crockford>(str); }
-		catch (std::exception const&) {};
+		v8::Local<v8::Object> options = args[3].As<v8::Object>();
+		v8pp::get_option(isolate, options, "largeFileSize", ar.blob_min_size);
+		v8pp::get_option(isolate, options, "blockSize", ar.block_size);
+		std::string cipher;
+		if (v8pp::get_option(isolate, options, "cipher", cipher))
+		{
+			ar.cipher = crypto::cipher_by_name(cipher);
+		}
+		v8pp::get_option(isolate, options, "bundle", ar.bundle);
+		v8pp::get_option(isolate, options, "bytecode", bytecode);
+		std::vector<std::string> lazy;
+		if (v8pp::get_option(isolate, options, "lazy", lazy))
+		{
+			ar.lazy.insert(lazy.begin(), lazy.end());
+		}
+		if (ar.block_size == 0)
+		{
+			throw std::invalid_argument("blockSize should be positive");
+		}
 
-		if (data_.size() != AUTH_LEN
-			|| checksum() != std::accumulate(data_.begin(), data_.end() - sizeof(uint16_t), uint16_t{}))
+		// profile file name or array of file paths in first-use order
+		v8::Local<v8::Value> profile;
+		if (v8pp::get_option(isolate, options, "profile", profile))
 		{
-			throw std::runtime_error("invalid auth data");
+			if (profile->IsString())
+			{
+				ar.profile = archive::read_profile(v8pp::from_v8<std::string>(isolate, profile));
+			}
+			else if (!profile->IsUndefined() && !profile->IsNull())
+			{
+				ar.profile = v8pp::from_v8<std::vector<path>>(isolate, profile);
+			}
 		}
 	}
-
-	std::string to_string(size_t const group_by = 4) const
+	v8::Local<v8::Array> ids = files->GetOwnPropertyNames();
+	for (uint32_t i = 0, count = ids->Length(); i != count; ++i)
 	{
-		std::string result = base32::encode<base32::crockford>(data_);
-		if (group_by)
+		v8::Local<v8::Value> const key = ids->Get(i);
+		v8::Local<v8::Value> const value = files->Get(key);
+		std::string const id = v8pp::from_v8<std::string>(isolate, key);
+		if (value->IsString())
+		{
+			// path to a file or a directory on disk
+			ar.add(id, v8pp::from_v8<path>(isolate, value));
+		}
+		else if (node::Buffer::HasInstance(value))
+		{
+			// single file module content
+			ar.add_memory_file(id, content_from_v8(isolate, value));
+		}
+		else if (value->IsObject())
 		{
-			for (auto pos = result.begin() + group_by; pos < result.end();)
+			// set of file contents keyed by virtual path in the module directory
+			v8::Local<v8::Object> dir = value.As<v8::Object>();
+			v8::Local<v8::Array> names = dir->GetOwnPropertyNames();
+			std::map<path, std::string> dir_files;
+			for (uint32_t j = 0, dir_count = names->Length(); j != dir_count; ++j)
 			{
-				pos = result.insert(pos, '-') + group_by + 1;
+				v8::Local<v8::Value> const name = names->Get(j);
+				dir_files.emplace(v8pp::from_v8<path>(isolate, name), content_from_v8(isolate, dir->Get(name)));
 			}
+			ar.add_memory_dir(id, std::move(dir_files));
+		}
+		else
+		{
+			throw std::invalid_argument(id + ": expected path string, Buffer or object");
 		}
-		return result;
 	}
+	ar.read_files();
 
-	uint16_t serial_number() const
+	if (args[3]->IsObject())
 	{
-		uint16_t result;
-		memcpy(&result, data_.data() + KEY_LEN, sizeof(result));
-		return result;
+		// remove files unreachable from module entry points, report them in options.pruned
+		v8::Local<v8::Object> options = args[3].As<v8::Object>();
+		v8::Local<v8::Value> prune;
+		if (v8pp::get_option(isolate, options, "prune", prune) && prune->BooleanValue())
+		{
+			archive::prune_rules rules;
+			if (prune->IsObject())
+			{
+				v8::Local<v8::Object> prune_options = prune.As<v8::Object>();
+				v8pp::get_option(isolate, prune_options, "include", rules.include);
+				v8pp::get_option(isolate, prune_options, "exclude", rules.exclude);
+				v8::Local<v8::Object> entries;
+				if (v8pp::get_option(isolate, prune_options, "entries", entries))
+				{
+					v8::Local<v8::Array> entry_ids = entries->GetOwnPropertyNames();
+					for (uint32_t i = 0, count = entry_ids->Length(); i != count; ++i)
+					{
+						v8::Local<v8::Value> const key = entry_ids->Get(i);
+						v8::Local<v8::Value> const value = entries->Get(key);
+						std::string const id = v8pp::from_v8<std::string>(isolate, key);
+						std::vector<path> const files = value->IsArray()?
+							v8pp::from_v8<std::vector<path>>(isolate, value)
+							: std::vector<path>(1, v8pp::from_v8<path>(isolate, value));
+						for (path const& file : files)
+						{
+							rules.entries.emplace(id, file);
+						}
+					}
+				}
+			}
+			archive::prune_result const pruned = ar.prune(rules);
+			v8::Local<v8::Object> report = v8::Object::New(isolate);
+			v8pp::set_option(isolate, report, "files", pruned.files);
+			v8pp::set_option(isolate, report, "bytes", static_cast<double>(pruned.bytes));
+			v8pp::set_option(isolate, options, "pruned", report);
+		}
 	}
 
-	uint16_t checksum() const
+	if (args[3]->IsObject())
 	{
-		uint16_t result;
-		memcpy(&result, data_.data() + KEY_LEN + sizeof(uint16_t), sizeof(result));
-		return result;
+		// true for all .js and .json files or an array of glob patterns
+		v8::Local<v8::Object> options = args[3].As<v8::Object>();
+		v8::Local<v8::Value> evictable;
+		if (v8pp::get_option(isolate, options, "evictable", evictable) && evictable->BooleanValue())
+		{
+			if (bytecode)
+			{
+				throw std::invalid_argument("evictable option can't be used with bytecode");
+			}
+			ar.mark_evictable(evictable->IsArray()?
+				v8pp::from_v8<std::vector<std::string>>(isolate, evictable) : std::vector<std::string>());
+		}
 	}
 
-	std::string pub_data() const { return data_.substr(KEY_LEN); }
-	std::string priv_key() const { return data_.substr(0, KEY_LEN); }
-};
-
-void package::gen_auth(v8::FunctionCallbackInfo<v8::Value> const& args)
-{
-	v8::Isolate* isolate = args.GetIsolate();
-
-	std::string const password = v8pp::from_v8<std::string>(isolate, args[0]);
-	uint16_t const serial = v8pp::from_v8<uint16_t>(isolate, args[1]);
-
-	auth_data const auth(isolate, password, serial);
+	if (bytecode)
+	{
+		make_bytecode(isolate, ar);
+	}
 
-	args.GetReturnValue().Set(v8pp::to_v8(isolate, auth.to_string()));
+	if (args[1]->IsUndefined() || args[1]->IsNull())
+	{
+		args.GetReturnValue().Set(string_buffer(isolate, ar.save(auth)));
+	}
+	else
+	{
+		ar.save(auth, v8pp::from_v8<std::string>(isolate, args[1]));
+	}
 }
 
-void package::make(v8::FunctionCallbackInfo<v8::Value> const& args)
-try
+void package::load(v8::FunctionCallbackInfo<v8::Value> const& args)
 {
 	v8::Isolate* isolate = args.GetIsolate();
-	v8::HandleScope scope(isolate);
-
-	using string_map = std::map<std::string, std::string>;
 
+	trace::span span("load");
 	auth_data const auth(v8pp::from_v8<std::string>(isolate, args[0]));
-	auto const filename = v8pp::from_v8<std::string>(isolate, args[1]);
-	auto const files = v8pp::from_v8<string_map>(isolate, args[2]);
 
-	sources_map sources;
-	modules_map modules;
-	for (auto const& file : files)
+	archive ar;
+	std::shared_ptr<archive const> cached;
+	v8::Local<v8::Value> const source = args[1];
+	bool keep_input = false;
+	if (node::Buffer::HasInstance(source))
 	{
-		std::string const& id = file.first;
-		path const p = file.second;
-		p.is_dir() ? load_dir(isolate, modules, sources, id, p) : load_file(modules, sources, id, p);
+		// decrypt directly from the buffer memory
+		ar = archive::load(auth, node::Buffer::Data(source), node::Buffer::Length(source));
+		keep_input = !ar.blobs.empty();
 	}
+	else if (source->IsArrayBuffer())
+	{
+		v8::ArrayBuffer::Contents const contents = source.As<v8::ArrayBuffer>()->GetContents();
+		ar = archive::load(auth, static_cast<char const*>(contents.Data()), contents.ByteLength());
+		keep_input = !ar.blobs.empty();
+	}
+	else if (source->IsNumber())
+	{
+		// package embedded into another file at some offset
+		int const fd = v8pp::from_v8<int>(isolate, source);
+		uint64_t const offset = v8pp::from_v8<uint64_t>(isolate, args[2], 0);
+		uint64_t const length = v8pp::from_v8<uint64_t>(isolate, args[3], mapped_file::npos);
+
+		file_status st;
+		std::string const key = (get_status(fd, st) == 0? cache_key(st, auth, offset, length) : "");
+		cached = load_cache.find(key);
+		if (!cached)
+		{
+			ar = archive::load(auth, fd, offset, length);
+			cached = load_cache.insert(key, std::move(ar));
+		}
+	}
+	else
+	{
+		std::string const filename = v8pp::from_v8<std::string>(isolate, source);
 
-	yas::mem_ostream mem(sources.size() * 40 * 1024);
-	yas::binary_oarchive<yas::mem_ostream> content(mem, yas::no_header);
-	content.serialize(modules, sources);
-
-	yas::intrusive_buffer const buf = mem.get_intrusive_buffer();
-	yas::shared_buffer auth_tag;
-	std::string iv;
-	yas::shared_buffer const cipher = encrypt(isolate, auth.priv_key(), iv, auth_tag, buf.data, buf.size);
+		file_status st;
+		std::string const key = (get_status(filename, st) == 0? cache_key(st, auth, 0, 0) : "");
+		cached = load_cache.find(key);
+		if (!cached)
+		{
+			ar = archive::load(auth, filename);
+			cached = load_cache.insert(key, std::move(ar));
+		}
+	}
 
-	yas::file_ostream file(filename.c_str(), yas::file_trunc);
-	yas::binary_oarchive<yas::file_ostream> out(file, yas::no_header);
-	out.serialize(SIGN, auth.pub_data(), iv, auth_tag, cipher);
-}
-catch (yas::io_exception const& ex)
-{
-	throw std::runtime_error(std::string("Package write error: ") + ex.what());
+	if (!cached)
+	{
+		cached = std::make_shared<archive const>(std::move(ar));
+	}
+	v8::Local<v8::Object> result = create(isolate, std::move(cached));
+	if (keep_input)
+	{
+		v8pp::class_<package>::unwrap_object(isolate, result)->input_.Reset(isolate, source);
+	}
+	args.GetReturnValue().Set(result);
 }
 
-void package::load(v8::FunctionCallbackInfo<v8::Value> const& args)
-try
+// V8 flag in the Node.js command line or in NODE_OPTIONS, in dashed
+// or underscored form. Flags set by v8.setFlagsFromString() are not seen
+static bool has_v8_flag(v8::Isolate* isolate, std::string const& flag)
 {
-	v8::Isolate* isolate = args.GetIsolate();
+	std::string underscored = flag;
+	std::replace(underscored.begin() + 2, underscored.end(), '-', '_');
 
-	auth_data const auth(v8pp::from_v8<std::string>(isolate, args[0]));
-	auto const filename = v8pp::from_v8<std::string>(isolate, args[1]);
-
-	std::decay<decltype(SIGN)>::type sign;
-	std::string pub_data, iv;
-	yas::shared_buffer auth_tag, cipher;
-
-	yas::file_istream file(filename.c_str());
-	yas::binary_iarchive<yas::file_istream> in(file, yas::no_header);
-	in.serialize(sign, pub_data, iv, auth_tag, cipher);
-	if (sign != SIGN)
+	std::vector<std::string> args;
+	v8::Local<v8::Object> process;
+	if (v8pp::get_option(isolate, isolate->GetCurrentContext()->Global(), "process", process))
 	{
-		throw std::runtime_error("Package invalid format");
+		v8pp::get_option(isolate, process, "execArgv", args);
 	}
-	if (pub_data != auth.pub_data())
+	if (char const* node_options = getenv("NODE_OPTIONS"))
 	{
-		throw std::runtime_error("Package invalid key");
+		std::istringstream options(node_options);
+		std::copy(std::istream_iterator<std::string>(options), std::istream_iterator<std::string>(),
+			std::back_inserter(args));
 	}
+	return std::find(args.begin(), args.end(), flag) != args.end()
+		|| std::find(args.begin(), args.end(), underscored) != args.end();
+}
 
-	std::unique_ptr<package> pkg(new package);
-	pkg->serial_number_ = auth.serial_number();
+// bytecode in the code cache refers to the source for functions compiled later,
+// so it should not be flushed. Process flags are not changed at runtime
+static void check_bytecode_flags(v8::Isolate* isolate)
+{
+#if V8_MAJOR_VERSION >= 7
+	if (!has_v8_flag(isolate, "--no-flush-bytecode"))
+	{
+		throw std::runtime_error("package bytecode requires Node.js started with --no-flush-bytecode");
+	}
+#else
+	(void)isolate;
+#endif
+}
+
+v8::Local<v8::Object> package::create(v8::Isolate* isolate, std::shared_ptr<archive const> ar)
+{
+	v8::EscapableHandleScope scope(isolate);
 
-	yas::shared_buffer const plain = decrypt(isolate, auth.priv_key(), iv, auth_tag, cipher.data.get(), cipher.size);
-	yas::mem_istream mem(plain);
-	yas::binary_iarchive<yas::mem_istream> content(mem, yas::no_header);
-	content.serialize(pkg->modules_, pkg->sources_);
+	if (!ar->code_cache.empty())
+	{
+		if (ar->v8_version != v8::V8::GetVersion())
+		{
+			throw std::runtime_error("package bytecode is made for V8 " + ar->v8_version
+				+ " but this is V8 " + v8::V8::GetVersion() + ", make the package with this Node.js version");
+		}
+		check_bytecode_flags(isolate);
+	}
 
+	std::unique_ptr<package> pkg(new package);
+	pkg->archive_ = std::move(ar);
+	char const* const stats_env = getenv("IRIS_CRYPT_STATS");
+	pkg->stats_.enabled = (stats_env && *stats_env && strcmp(stats_env, "0") != 0);
 	pkg->js_modules_.Reset(isolate, v8::Object::New(isolate));
+	pkg->js_compiled_.Reset(isolate, v8::Object::New(isolate));
+	pkg->isolate_ = isolate;
+	pkg->count_memory(true);
 	v8::Local<v8::Object> result = v8pp::class_<package>::import_external(isolate, pkg.release());
 
-	args.GetReturnValue().Set(result);
+	return scope.Escape(result);
 }
-catch (yas::io_exception const& ex)
+
+package::~package()
 {
-	throw std::runtime_error(std::string("Package read error: ") + ex.what());
+	close();
 }
 
-std::vector<std::string> package::names() const
+void package::close()
 {
-	std::vector<std::string> result;
-	for (auto const& kv : modules_)
+	js_modules_.Reset();
+	js_compiled_.Reset();
+	js_bundle_.Reset();
+	input_.Reset();
+	if (shared_fd_ >= 0)
 	{
-		result.emplace_back(kv.first);
+		close_file(shared_fd_);
+		shared_fd_ = -1;
 	}
-	std::sort(result.begin(), result.end());
-	return result;
+	// the contents are freed when no other package or thread uses them
+	count_memory(false);
+	archive_.reset();
+	release_arena();
+	std::stack<path>().swap(require_dir_stack_);
+	std::vector<path>().swap(profile_);
+	stats_.modules.clear();
+	evictable_index_.clear();
+	evictable_.clear();
+	evictable_held_ = 0;
 }
 
-v8::Local<v8::Value> package::require_module(v8::Isolate* isolate, std::string const& id, path const& file, std::string const& source)
+archive const& package::contents() const
 {
-	// re-define require() function in a wrapped source
-	// because for some reason V8 can't reference it
-	// from this package object prototype
-	char const wrapper_begin[] = 
-		"(function (exports, module, __filename, __dirname){"
-		"var require = function(name) { return module.require(name) };";
-	char const wrapper_end[] = "\n});";
-
-	// wrap module.source into JavaScript (function(){}) to hide the module source code
-	std::string wrapped_source;
-	wrapped_source.reserve(source.length() + sizeof(wrapper_begin) + sizeof(wrapper_end) - 2);
-	wrapped_source.append(wrapper_begin, sizeof(wrapper_begin) - 1);
-	wrapped_source.append(source);
-	wrapped_source.append(wrapper_end, sizeof(wrapper_end) - 1);
+	if (!archive_)
+	{
+		throw std::runtime_error("package is closed");
+	}
+	return *archive_;
+}
 
-	v8::TryCatch try_catch;
+void package::count_memory(bool add)
+{
+	if (!isolate_ || !archive_ || memory_counted_ == add)
+	{
+		return;
+	}
+	memory_counted_ = add;
 
-	// compile and run wrapped source to get a wrapped JS function
-	v8::ScriptOrigin origin(v8pp::to_v8(isolate, id));
-	v8::Local<v8::Script> script = v8::Script::Compile(v8pp::to_v8(isolate, wrapped_source), &origin);
-	if (try_catch.HasCaught())
+	bool changed;
 	{
-		try_catch.ReThrow();
-		return v8::Undefined(isolate);
+		std::lock_guard<std::mutex> lock(memory_users_mutex);
+		auto const key = std::make_pair(isolate_, archive_.get());
+		uint32_t& users = memory_users[key];
+		changed = (add? users++ == 0 : --users == 0);
+		if (users == 0)
+		{
+			memory_users.erase(key);
+		}
 	}
-	v8::Local<v8::Function> wrapped_script = script->Run().As<v8::Function>();
-	if (try_catch.HasCaught())
+	if (changed)
 	{
-		try_catch.ReThrow();
-		return v8::Undefined(isolate);
+		int64_t const size = archive_->memory_size();
+		isolate_->AdjustAmountOfExternalAllocatedMemory(add? size : -size);
 	}
+}
 
-	// create a module object and set it protoptype to this package
-	v8::Local<v8::Object> js_module = v8::Object::New(isolate);
-	js_module->SetPrototype(v8pp::to_v8(isolate, this));
-
-	// setup the module object
-	v8::Local<v8::Object> exports = v8::Object::New(isolate);
-	v8pp::set_option(isolate, js_module, "exports", exports);
-	v8pp::set_const(isolate, js_module, "id", id);
-	v8pp::set_const(isolate, js_module, "filename", file);
-	v8pp::set_option(isolate, js_module, "loaded", false);
-
-	// call wrapped function
-	v8pp::call_v8(isolate, wrapped_script, js_module, exports,js_module, file, file.parent());
-	if (try_catch.HasCaught())
+uint32_t package::share()
+{
+	contents();
+	if (!input_.IsEmpty())
 	{
-		try_catch.ReThrow();
-		return v8::Undefined(isolate);
+		throw std::runtime_error("package with large files loaded from a Buffer can't be shared");
 	}
 
-	// get exports object
-	v8pp::set_option(isolate, js_module, "loaded", true);
-	v8pp::get_option(isolate, js_module, "exports", exports);
-	return exports;
+	std::lock_guard<std::mutex> lock(shared_mutex);
+	for (auto it = shared_archives.begin(); it != shared_archives.end(); )
+	{
+		if (it->second.expired()) it = shared_archives.erase(it);
+		else if (it->second.lock() == archive_) return it->first;
+		else ++it;
+	}
+	uint32_t const id = shared_next_id++;
+	shared_archives.emplace(id, archive_);
+	return id;
 }
 
-v8::Local<v8::Value> package::require_original(v8::Isolate* isolate, std::string const& id)
+int package::share_memory()
 {
-	// load node module using original require function
-	v8::Local<v8::Object> module = v8pp::to_local(isolate, node_module);
-	v8::Local<v8::Function> require = v8pp::to_local(isolate, node_require);
-	v8::TryCatch try_catch;
-	v8::Local<v8::Value> result = v8pp::call_v8(isolate, require, module, id);
-	if (try_catch.HasCaught())
+	if (shared_fd_ < 0)
 	{
-		return try_catch.ReThrow();
+		shared_fd_ = contents().share_memory();
 	}
-	return result;
+	return shared_fd_;
 }
 
-void package::require(v8::FunctionCallbackInfo<v8::Value> const& args)
+void package::load_shared(v8::FunctionCallbackInfo<v8::Value> const& args)
 {
 	v8::Isolate* isolate = args.GetIsolate();
 
-	std::string const id = v8pp::from_v8<std::string>(isolate, args[0], "");
-	if (id.empty())
-	{
-		throw std::runtime_error("name argument empty");
-	}
+	auth_data const auth(v8pp::from_v8<std::string>(isolate, args[0]));
+	int const fd = v8pp::from_v8<int>(isolate, args[1]);
 
-	path name;
-	auto it = modules_.find(id);
-	if (it != modules_.end())
+	trace::span span("load");
+	archive ar = archive::load_shared(auth, fd);
+	args.GetReturnValue().Set(create(isolate, std::make_shared<archive const>(std::move(ar))));
+}
+
+void package::attach(v8::FunctionCallbackInfo<v8::Value> const& args)
+{
+	v8::Isolate* isolate = args.GetIsolate();
+
+	uint32_t const id = v8pp::from_v8<uint32_t>(isolate, args[0]);
+	std::shared_ptr<archive const> ar;
 	{
-		name = it->second;
+		std::lock_guard<std::mutex> lock(shared_mutex);
+		auto const it = shared_archives.find(id);
+		if (it != shared_archives.end())
+		{
+			ar = it->second.lock();
+		}
 	}
-	else
+	if (!ar)
 	{
-		name = (id[0] == '.' && !require_dir_stack_.empty()? require_dir_stack_.top() / id : id);
-		name.add_extension(".js");
+		throw std::runtime_error("no shared package " + std::to_string(id) + ", it should be alive in the sharing thread");
 	}
+	args.GetReturnValue().Set(create(isolate, std::move(ar)));
+}
 
+v8::Local<v8::Object> package::stats(v8::Isolate* isolate) const
+{
 	v8::EscapableHandleScope scope(isolate);
 
-	v8::Local<v8::Object> js_modules = v8pp::to_local(isolate, js_modules_);
-	v8::Local<v8::String> js_name = v8pp::to_v8(isolate, name);
-	v8::Local<v8::Value> js_module = js_modules->Get(js_name);
-	if (js_module.IsEmpty() || js_module->IsUndefined())
+	v8::Local<v8::Object> load = v8::Object::New(isolate);
+	v8pp::set_option(isolate, load, "readMs", ns_to_ms(contents().timings.read_ns));
+	v8pp::set_option(isolate, load, "decryptMs", ns_to_ms(contents().timings.decrypt_ns));
+	v8pp::set_option(isolate, load, "deserializeMs", ns_to_ms(contents().timings.deserialize_ns));
+
+	v8::Local<v8::Object> modules = v8::Object::New(isolate);
+	for (auto const& module : stats_.modules)
 	{
-		auto src = sources_.find(name);
-		if (src == sources_.end())
-		{
-			args.GetReturnValue().Set(require_original(isolate, id));
-			return;
-		}
-		std::string& source = src->second;
+		v8::Local<v8::Object> item = v8::Object::New(isolate);
+		v8pp::set_option(isolate, item, "compileMs", ns_to_ms(module.second.compile_ns));
+		v8pp::set_option(isolate, item, "executeMs", ns_to_ms(module.second.execute_ns));
+		v8pp::set_option(isolate, modules, module.first.c_str(), item);
+	}
 
-		if (name.extension() == ".json")
-		{
-			js_module = v8::JSON::Parse(v8pp::to_v8(isolate, source));
-		}
-		else
-		{
+	v8::Local<v8::Object> result = v8::Object::New(isolate);
+	v8pp::set_option(isolate, result, "enabled", stats_.enabled);
+	v8pp::set_option(isolate, result, "load", load);
+	v8pp::set_option(isolate, result, "requires", static_cast<double>(stats_.requires));
+	v8pp::set_option(isolate, result, "cacheHits", static_cast<double>(stats_.cache_hits));
+	v8pp::set_option(isolate, result, "fallbacks", static_cast<double>(stats_.fallbacks));
+	v8pp::set_option(isolate, result, "compiled", static_cast<double>(stats_.compiled));
+	v8pp::set_option(isolate, result, "compileMs", ns_to_ms(stats_.compile_ns));
+	v8pp::set_option(isolate, result, "executed", static_cast<double>(stats_.executed));
+	v8pp::set_option(isolate, result, "executeMs", ns_to_ms(stats_.execute_ns));
+	v8pp::set_option(isolate, result, "blobReads", static_cast<double>(stats_.blob_reads));
+	v8pp::set_option(isolate, result, "blobDecryptMs", ns_to_ms(stats_.blob_decrypt_ns));
+	v8pp::set_option(isolate, result, "evictions", static_cast<double>(stats_.evictions));
+	v8pp::set_option(isolate, result, "bytesHeld", static_cast<double>(contents().content_size()));
+	v8pp::set_option(isolate, result, "modules", modules);
+	return scope.Escape(result);
+}
+
+std::vector<std::string> package::names() const
+{
+	return contents().info().names();
+}
+
+// file metadata object for stat() and inspect()
+static v8::Local<v8::Object> file_info(v8::Isolate* isolate, package_info::file const& file)
+{
+	v8::EscapableHandleScope scope(isolate);
+
+	v8::Local<v8::Object> result = v8::Object::New(isolate);
+	v8pp::set_option(isolate, result, "name", file.name);
+	v8pp::set_option(isolate, result, "kind", package_info::kind_name(file.kind));
+	v8pp::set_option(isolate, result, "size", static_cast<double>(file.size));
+	v8pp::set_option(isolate, result, "storedSize", static_cast<double>(file.stored_size));
+	v8pp::set_option(isolate, result, "ratio", file.ratio());
+	if (!file.hash.empty())
+	{
+		v8pp::set_option(isolate, result, "hash", file.hash_hex());
+	}
+	return scope.Escape(result);
+}
+
+bool package::has(std::string const& name) const
+{
+	package_info const& info = contents().info();
+	package_info::file file;
+	return std::binary_search(info.names().begin(), info.names().end(), name)
+		|| info.find(name, file);
+}
+
+v8::Local<v8::Object> package::stat(v8::Isolate* isolate, std::string const& name) const
+{
+	package_info const& info = contents().info();
+	path file_path = name;
+	auto const module = std::lower_bound(info.modules().begin(), info.modules().end(), name,
+		[](package_info::modules_list::value_type const& module, std::string const& name)
+		{ return module.first < name; });
+	if (module != info.modules().end() && module->first == name)
+	{
+		file_path = module->second;
+	}
+	package_info::file file;
+	if (!info.find(file_path, file))
+	{
+		throw std::runtime_error("no such file in package: " + file_path.str());
+	}
+	return file_info(isolate, file);
+}
+
+void package::list(v8::FunctionCallbackInfo<v8::Value> const& args)
+{
+	v8::Isolate* isolate = args.GetIsolate();
+	std::string const prefix = v8pp::from_v8<std::string>(isolate, args[0], "");
+
+	std::vector<std::string> result;
+	for (package_info::file const& file : contents().info().list(prefix))
+	{
+		result.emplace_back(file.name.str());
+	}
+	args.GetReturnValue().Set(v8pp::to_v8(isolate, result));
+}
+
+void package::inspect(v8::FunctionCallbackInfo<v8::Value> const& args)
+{
+	v8::Isolate* isolate = args.GetIsolate();
+
+	auth_data const auth(v8pp::from_v8<std::string>(isolate, args[0]));
+	package_info const info = archive::inspect(auth, v8pp::from_v8<std::string>(isolate, args[1]));
+
+	v8::EscapableHandleScope scope(isolate);
+
+	v8::Local<v8::Object> modules = v8::Object::New(isolate);
+	for (auto const& module : info.modules())
+	{
+		v8pp::set_option(isolate, modules, module.first.c_str(), module.second);
+	}
+
+	std::vector<package_info::file> const files = info.list();
+	v8::Local<v8::Array> files_array = v8::Array::New(isolate, static_cast<int>(files.size()));
+	for (uint32_t i = 0; i < files.size(); ++i)
+	{
+		files_array->Set(i, file_info(isolate, files[i]));
+	}
+
+	v8::Local<v8::Object> result = v8::Object::New(isolate);
+	v8pp::set_option(isolate, result, "serial", auth.serial_number());
+	v8pp::set_option(isolate, result, "names", info.names());
+	v8pp::set_option(isolate, result, "modules", modules);
+	v8pp::set_option(isolate, result, "files", files_array);
+	if (!info.v8_version().empty())
+	{
+		v8pp::set_option(isolate, result, "v8Version", info.v8_version());
+	}
+	args.GetReturnValue().Set(scope.Escape(result));
+}
+
+void package::diff(v8::FunctionCallbackInfo<v8::Value> const& args)
+{
+	v8::Isolate* isolate = args.GetIsolate();
+
+	delta::diff_result const diff = delta::diff(v8pp::from_v8<std::string>(isolate, args[0]),
+		v8pp::from_v8<std::string>(isolate, args[1]), v8pp::from_v8<std::string>(isolate, args[2]));
+
+	v8::EscapableHandleScope scope(isolate);
+
+	v8::Local<v8::Object> result = v8::Object::New(isolate);
+	v8pp::set_option(isolate, result, "size", static_cast<double>(diff.size));
+	v8pp::set_option(isolate, result, "copied", static_cast<double>(diff.copied));
+	v8pp::set_option(isolate, result, "added", static_cast<double>(diff.added));
+	args.GetReturnValue().Set(scope.Escape(result));
+}
+
+v8::Local<v8::Value> package::run_script(v8::Isolate* isolate, std::string const& origin_name, string_ref const& source)
+{
+	v8::EscapableHandleScope scope(isolate);
+	v8::TryCatch try_catch;
+
+	v8::ScriptOrigin origin(v8pp::to_v8(isolate, origin_name));
+	v8::Local<v8::Script> script = v8::Script::Compile(
+		v8pp::to_v8(isolate, source.data(), static_cast<int>(source.size())), &origin);
+	if (try_catch.HasCaught())
+	{
+		try_catch.ReThrow();
+		return v8::Local<v8::Value>();
+	}
+	v8::Local<v8::Value> result = script->Run();
+	if (try_catch.HasCaught())
+	{
+		try_catch.ReThrow();
+		return v8::Local<v8::Value>();
+	}
+	return scope.Escape(result);
+}
+
+v8::Local<v8::Function> package::compile_module(v8::Isolate* isolate, std::string const& origin_name, string_ref const& source)
+{
+	// re-define require() function in a wrapped source
+	// because for some reason V8 can't reference it
+	// from this package object prototype
+	std::string const wrapper_begin = archive::module_wrapper_begin;
+	std::string const wrapper_end = archive::module_wrapper_end;
+
+	// wrap module.source into JavaScript (function(){}) to hide the module source code
+	std::string wrapped_source;
+	wrapped_source.reserve(source.size() + wrapper_begin.size() + wrapper_end.size());
+	wrapped_source.append(wrapper_begin);
+	wrapped_source.append(source.data(), source.size());
+	wrapped_source.append(wrapper_end);
+
+	// compile and run wrapped source to get a wrapped JS function
+	v8::EscapableHandleScope scope(isolate);
+	v8::Local<v8::Value> result = run_script(isolate, origin_name, wrapped_source);
+	drop_plaintext(wrapped_source);
+	if (result.IsEmpty())
+	{
+		return v8::Local<v8::Function>();
+	}
+	return scope.Escape(result.As<v8::Function>());
+}
+
+v8::Local<v8::Function> package::module_function(v8::Isolate* isolate, std::string const& origin_name,
+	path const& file, string_ref const& source)
+{
+	v8::EscapableHandleScope scope(isolate);
+	v8::TryCatch try_catch;
+	stats_timer timer(stats_, stats_.compile_ns, file, &module_stats::compile_ns);
+	trace::span span("compile", file.str());
+
+	v8::Local<v8::Function> result;
+	auto const cached = contents().code_cache.find(file);
+	if (cached != contents().code_cache.end())
+	{
+		result = compile_cached(isolate, file, cached->second);
+	}
+	else if (contents().bundle)
+	{
+		result = bundled_module(isolate, file);
+	}
+	if (result.IsEmpty() && !try_catch.HasCaught() && cached == contents().code_cache.end())
+	{
+		result = compile_module(isolate, origin_name, source);
+	}
+	if (result.IsEmpty())
+	{
+		try_catch.ReThrow();
+		return result;
+	}
+	++stats_.compiled;
+	return scope.Escape(result);
+}
+
+// V8 code cache for functions of a wrapped module source, compiled eagerly
+static std::string produce_code_cache(v8::Isolate* isolate, std::string const& origin_name,
+	std::string const& wrapped_source)
+{
+	v8::HandleScope scope(isolate);
+	v8::TryCatch try_catch;
+
+	v8::ScriptOrigin origin(v8pp::to_v8(isolate, origin_name));
+	v8::ScriptCompiler::Source source(v8pp::to_v8(isolate, wrapped_source), origin);
+#if V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 7)
+	v8::Local<v8::UnboundScript> script;
+	std::unique_ptr<v8::ScriptCompiler::CachedData> data;
+	if (v8::ScriptCompiler::CompileUnboundScript(isolate, &source, v8::ScriptCompiler::kEagerCompile).ToLocal(&script))
+	{
+		data.reset(v8::ScriptCompiler::CreateCodeCache(script));
+	}
+#else
+	// all functions are compiled with --no-lazy, checked in make_bytecode()
+	v8::ScriptCompiler::CompileUnbound(isolate, &source, v8::ScriptCompiler::kProduceCodeCache);
+	v8::ScriptCompiler::CachedData const* data = source.GetCachedData();
+#endif
+	if (try_catch.HasCaught() || !data)
+	{
+		std::string const error = try_catch.HasCaught()?
+			v8pp::from_v8<std::string>(isolate, try_catch.Exception()->ToString()) : "no code cache";
+		throw std::runtime_error("can't compile " + origin_name + ": " + error);
+	}
+	return std::string(reinterpret_cast<char const*>(data->data), data->length);
+}
+
+void package::make_bytecode(v8::Isolate* isolate, archive& ar)
+{
+	if (ar.bundle)
+	{
+		throw std::invalid_argument("bundle and bytecode options can't be used together");
+	}
+#if V8_MAJOR_VERSION < 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION < 7)
+	// V8 without eager compile option compiles all functions only with --no-lazy
+	if (!has_v8_flag(isolate, "--no-lazy"))
+	{
+		throw std::runtime_error("package bytecode with V8 " + std::string(v8::V8::GetVersion())
+			+ " requires Node.js started with --no-lazy");
+	}
+#endif
+
+	// dependencies are found in the sources, which are not stored
+	ar.dependencies = ar.find_dependencies();
+	ar.v8_version = v8::V8::GetVersion();
+
+	std::vector<std::pair<path, string_ref>> js_sources;
+	for (auto const& source : ar.sources)
+	{
+		if (source.first.extension() == ".js") js_sources.emplace_back(source);
+	}
+	for (auto const& source : js_sources)
+	{
+		std::string wrapped_source = archive::module_wrapper_begin;
+		wrapped_source.append(source.second.data(), source.second.size());
+		wrapped_source += archive::module_wrapper_end;
+		ar.add_code_cache(source.first, wrapped_source.size(),
+			produce_code_cache(isolate, source.first.str(), wrapped_source));
+	}
+}
+
+v8::Local<v8::Function> package::compile_cached(v8::Isolate* isolate, path const& file,
+	archive::compiled_module const& module)
+{
+	v8::EscapableHandleScope scope(isolate);
+	v8::TryCatch try_catch;
+
+	// V8 checks the source length only, the code cache is not copied
+	std::string const placeholder(static_cast<size_t>(module.source_size), ' ');
+	v8::ScriptOrigin origin(v8pp::to_v8(isolate, file));
+	v8::ScriptCompiler::CachedData* cached_data = new v8::ScriptCompiler::CachedData(
+		reinterpret_cast<uint8_t const*>(module.cache.data()), static_cast<int>(module.cache.size()));
+	v8::ScriptCompiler::Source source(v8pp::to_v8(isolate, placeholder), origin, cached_data);
+#if V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 7)
+	v8::Local<v8::UnboundScript> script;
+	v8::ScriptCompiler::CompileUnboundScript(isolate, &source, v8::ScriptCompiler::kConsumeCodeCache).ToLocal(&script);
+#else
+	v8::Local<v8::UnboundScript> script = v8::ScriptCompiler::CompileUnbound(isolate, &source, v8::ScriptCompiler::kConsumeCodeCache);
+#endif
+	if (try_catch.HasCaught())
+	{
+		try_catch.ReThrow();
+		return v8::Local<v8::Function>();
+	}
+	if (source.GetCachedData()->rejected)
+	{
+		throw std::runtime_error("bytecode of " + file.str() + " is rejected by V8, "
+			"the package should be made with the same Node.js version and V8 flags");
+	}
+	v8::Local<v8::Value> result = script->BindToCurrentContext()->Run();
+	if (try_catch.HasCaught())
+	{
+		try_catch.ReThrow();
+		return v8::Local<v8::Function>();
+	}
+	return scope.Escape(result.As<v8::Function>());
+}
+
+v8::Local<v8::Function> package::bundled_module(v8::Isolate* isolate, path const& file)
+{
+	auto const index = contents().bundle_index.find(file);
+	if (index == contents().bundle_index.end())
+	{
+		return v8::Local<v8::Function>();
+	}
+
+	v8::EscapableHandleScope scope(isolate);
+
+	// the whole bundle is compiled once, V8 compiles module functions lazily
+	if (js_bundle_.IsEmpty())
+	{
+		v8::Local<v8::Value> bundle = run_script(isolate, "iris-crypt bundle", contents().bundle_script);
+		if (bundle.IsEmpty() || !bundle->IsArray())
+		{
+			return v8::Local<v8::Function>();
+		}
+		js_bundle_.Reset(isolate, bundle.As<v8::Array>());
+	}
+	v8::Local<v8::Array> bundle = v8pp::to_local(isolate, js_bundle_);
+	return scope.Escape(bundle->Get(index->second).As<v8::Function>());
+}
+
+v8::Local<v8::Value> package::require_module(v8::Isolate* isolate, std::string const& id, path const& file, std::string& source)
+{
+	v8::TryCatch try_catch;
+
+	// use the function compiled ahead in compile() if any
+	v8::Local<v8::Function> wrapped_script;
+	v8::Local<v8::Object> js_compiled = v8pp::to_local(isolate, js_compiled_);
+	v8::Local<v8::String> js_file = v8pp::to_v8(isolate, file);
+	v8::Local<v8::Value> compiled = js_compiled->Get(js_file);
+	if (!compiled.IsEmpty() && compiled->IsFunction())
+	{
+		wrapped_script = compiled.As<v8::Function>();
+		js_compiled->Delete(js_file);
+	}
+	else
+	{
+		wrapped_script = module_function(isolate, id, file, source);
+		drop_plaintext(source);
+		if (wrapped_script.IsEmpty())
+		{
+			try_catch.ReThrow();
+			return v8::Undefined(isolate);
+		}
+	}
+
+	// create a module object and set it protoptype to this package
+	v8::Local<v8::Object> js_module = v8::Object::New(isolate);
+	js_module->SetPrototype(v8pp::to_v8(isolate, this));
+
+	// setup the module object
+	v8::Local<v8::Object> exports = v8::Object::New(isolate);
+	v8pp::set_option(isolate, js_module, "exports", exports);
+	v8pp::set_const(isolate, js_module, "id", id);
+	v8pp::set_const(isolate, js_module, "filename", file);
+	v8pp::set_option(isolate, js_module, "loaded", false);
+
+	// call wrapped function
+	{
+		stats_timer timer(stats_, stats_.execute_ns, file, &module_stats::execute_ns);
+		trace::span span("execute", file.str());
+		v8pp::call_v8(isolate, wrapped_script, js_module, exports,js_module, file, file.parent());
+		++stats_.executed;
+	}
+	if (try_catch.HasCaught())
+	{
+		try_catch.ReThrow();
+		return v8::Undefined(isolate);
+	}
+
+	// get exports object
+	v8pp::set_option(isolate, js_module, "loaded", true);
+	v8pp::get_option(isolate, js_module, "exports", exports);
+	return exports;
+}
+
+v8::Local<v8::Value> package::require_original(v8::Isolate* isolate, std::string const& id)
+{
+	// load node module using original require function
+	isolate_state& state = package::state(isolate);
+	v8::Local<v8::Object> module = v8pp::to_local(isolate, state.node_module);
+	v8::Local<v8::Function> require = v8pp::to_local(isolate, state.node_require);
+	v8::TryCatch try_catch;
+	v8::Local<v8::Value> result = v8pp::call_v8(isolate, require, module, id);
+	if (try_catch.HasCaught())
+	{
+		return try_catch.ReThrow();
+	}
+	return result;
+}
+
+void package::require(v8::FunctionCallbackInfo<v8::Value> const& args)
+{
+	v8::Isolate* isolate = args.GetIsolate();
+
+	std::string const id = v8pp::from_v8<std::string>(isolate, args[0], "");
+	if (id.empty())
+	{
+		throw std::runtime_error("name argument empty");
+	}
+	trace::span span("require", id);
+
+	path name;
+	auto it = contents().modules.find(id);
+	if (it != contents().modules.end())
+	{
+		name = it->second;
+	}
+	else
+	{
+		name = (id[0] == '.' && !require_dir_stack_.empty()? require_dir_stack_.top() / id : id);
+		name.add_extension(".js");
+	}
+
+	v8::EscapableHandleScope scope(isolate);
+
+	++stats_.requires;
+	v8::Local<v8::Object> js_modules = v8pp::to_local(isolate, js_modules_);
+	v8::Local<v8::String> js_name = v8pp::to_v8(isolate, name);
+	v8::Local<v8::Value> js_module = js_modules->Get(js_name);
+	if (!js_module.IsEmpty() && !js_module->IsUndefined())
+	{
+		++stats_.cache_hits;
+	}
+	else if (contents().evictable.count(name))
+	{
+		// evictable module exports are not kept in js_modules_
+		js_module = require_evictable(isolate, id, name);
+	}
+	else
+	{
+		// only the code cache is stored for modules in bytecode packages
+		if (!contents().has_source(name) && contents().code_cache.find(name) == contents().code_cache.end())
+		{
+			++stats_.fallbacks;
+			args.GetReturnValue().Set(require_original(isolate, id));
+			return;
+		}
+
+		// modules marked lazy in the package are loaded on the first use,
+		// with require(name, true, id) called from the lazyRequire() proxy
+		if (!args[1]->BooleanValue() && contents().lazy.find(id) != contents().lazy.end())
+		{
+			v8::Local<v8::Function> lazy_require;
+			if (v8pp::get_option(isolate, args.This(), "lazyRequire", lazy_require))
+			{
+				v8::TryCatch try_catch;
+				v8::Local<v8::Value> result = v8pp::call_v8(isolate, lazy_require, args.This(), name, id);
+				if (try_catch.HasCaught())
+				{
+					try_catch.ReThrow();
+					return;
+				}
+				args.GetReturnValue().Set(scope.Escape(result));
+				return;
+			}
+		}
+
+		// the module id in require() call for a resolved name from the lazy proxy
+		std::string const module_id = (args[2]->IsString()? v8pp::from_v8<std::string>(isolate, args[2]) : id);
+
+		std::string source;
+		contents().copy_source(name, source);
+		profile_.emplace_back(name);
+		if (name.extension() == ".json")
+		{
+			stats_timer timer(stats_, stats_.compile_ns, name, &module_stats::compile_ns);
+			trace::span span("compile", name.str());
+			js_module = v8::JSON::Parse(v8pp::to_v8(isolate, source.data(), static_cast<int>(source.size())));
+			++stats_.compiled;
+			drop_plaintext(source);
+		}
+		else
+		{
+			prefetch_dependencies(isolate, name);
 			require_dir_stack_.push(name.parent());
-			js_module = require_module(isolate, id, name, source);
+			js_module = require_module(isolate, module_id, name, source);
 			require_dir_stack_.pop();
 		}
-		source.clear();
-		source.shrink_to_fit();
 		js_modules->Set(js_name, js_module);
 	}
 	args.GetReturnValue().Set(scope.Escape(js_module));
 }
 
-void package::load_dir(v8::Isolate* isolate, modules_map& modules, sources_map& sources, std::string const& id, path const& p)
+v8::Local<v8::Value> package::require_evictable(v8::Isolate* isolate, std::string const& id, path const& file)
 {
-	path const base = p.parent();
-	path main = p / "index.js";
+	v8::EscapableHandleScope scope(isolate);
 
-	for (path const& file : p.list_files())
+	auto const found = evictable_index_.find(file);
+	if (found != evictable_index_.end())
 	{
-		std::string const content = file.content();
-		if (file.relative_to(p) == "package.json")
+		evictable_module& module = *found->second;
+		if (!module.exports.IsEmpty())
 		{
-			v8::Local<v8::Object> json = v8::JSON::Parse(v8pp::to_v8(isolate, content)).As<v8::Object>();
-			if (json.IsEmpty() || !json->IsObject())
+			++stats_.cache_hits;
+			v8::Local<v8::Value> exports = v8pp::to_local(isolate, module.exports);
+			if (module.weak)
 			{
-				throw std::runtime_error(id + ": can't load " + file.str());
+				module.exports.Reset(isolate, exports);
+				module.weak = false;
+				evictable_held_ += module.size;
 			}
-			if (!v8pp::get_option(isolate, json, "main", main))
+			evictable_.splice(evictable_.begin(), evictable_, found->second);
+			evict();
+			return scope.Escape(exports);
+		}
+		// exports were collected, make the module again
+		evictable_.erase(found->second);
+		evictable_index_.erase(found);
+	}
+
+	auto const blob = contents().blobs.find(file);
+	if (blob == contents().blobs.end())
+	{
+		throw std::runtime_error("evictable file " + file.str() + " not found");
+	}
+
+	// plain source lives until compiled
+	std::string source(static_cast<size_t>(blob->second.size), 0);
+	{
+		stats_timer timer(stats_, stats_.blob_decrypt_ns);
+		trace::span span("decrypt", file.str());
+		contents().read_blob(blob->second, 0, source.size(), &source[0]);
+		++stats_.blob_reads;
+	}
+	profile_.emplace_back(file);
+
+	v8::TryCatch try_catch;
+	v8::Local<v8::Value> exports;
+	if (file.extension() == ".json")
+	{
+		stats_timer timer(stats_, stats_.compile_ns, file, &module_stats::compile_ns);
+		trace::span span("compile", file.str());
+		exports = v8::JSON::Parse(v8pp::to_v8(isolate, source.data(), static_cast<int>(source.size())));
+		++stats_.compiled;
+		drop_plaintext(source);
+	}
+	else
+	{
+		v8::Local<v8::Function> function = module_function(isolate, id, file, source);
+		drop_plaintext(source);
+		if (!function.IsEmpty())
+		{
+			// require_module() takes the function compiled ahead
+			v8pp::to_local(isolate, js_compiled_)->Set(v8pp::to_v8(isolate, file), function);
+			prefetch_dependencies(isolate, file);
+			require_dir_stack_.push(file.parent());
+			exports = require_module(isolate, id, file, source);
+			require_dir_stack_.pop();
+		}
+	}
+	if (try_catch.HasCaught())
+	{
+		try_catch.ReThrow();
+		return v8::Undefined(isolate);
+	}
+
+	evictable_.emplace_front();
+	evictable_module& module = evictable_.front();
+	module.file = file;
+	module.size = blob->second.size;
+	module.exports.Reset(isolate, exports);
+	evictable_index_[file] = evictable_.begin();
+	evictable_held_ += module.size;
+	evict();
+	return scope.Escape(exports);
+}
+
+void package::evict()
+{
+	if (memory_limit_ == 0)
+	{
+		return;
+	}
+
+	v8::HandleScope scope(isolate_);
+	for (auto it = evictable_.end(); it != evictable_.begin() && evictable_held_ > memory_limit_; )
+	{
+		evictable_module& module = *--it;
+		if (module.weak || module.exports.IsEmpty())
+		{
+			continue;
+		}
+		module.weak = true;
+		evictable_held_ -= module.size;
+		++stats_.evictions;
+		// primitive exports are kept, objects may be collected
+		if (v8pp::to_local(isolate_, module.exports)->IsObject())
+		{
+			module.exports.SetWeak(&module,
+				[](v8::WeakCallbackData<v8::Value, evictable_module> const& data)
 			{
-				throw std::runtime_error(id + ": no \"main\" in " + file.str());
-			}
-			main = p / main;
-			main.add_extension(".js");
+				data.GetParameter()->exports.Reset();
+			});
+		}
+	}
+}
+
+void package::set_memory_limit(uint64_t limit)
+{
+	memory_limit_ = limit;
+	evict();
+}
+
+void package::compile(v8::FunctionCallbackInfo<v8::Value> const& args)
+{
+	v8::Isolate* isolate = args.GetIsolate();
+	v8::HandleScope scope(isolate);
+
+	args.GetReturnValue().Set(compile_file(isolate, file_name(isolate, args[0], true)));
+}
+
+bool package::compile_file(v8::Isolate* isolate, path const& file)
+{
+	if ((!contents().has_source(file) && contents().code_cache.find(file) == contents().code_cache.end())
+		|| file.extension() != ".js")
+	{
+		return false;
+	}
+
+	v8::Local<v8::String> js_file = v8pp::to_v8(isolate, file);
+	v8::Local<v8::Object> js_modules = v8pp::to_local(isolate, js_modules_);
+	v8::Local<v8::Object> js_compiled = v8pp::to_local(isolate, js_compiled_);
+	if (js_modules->Has(js_file) || js_compiled->Has(js_file))
+	{
+		return false;
+	}
+
+	std::string source;
+	contents().copy_source(file, source);
+	v8::TryCatch try_catch;
+	v8::Local<v8::Function> wrapped_script = module_function(isolate, file.str(), file, source);
+	drop_plaintext(source);
+	if (wrapped_script.IsEmpty())
+	{
+		try_catch.ReThrow();
+		return false;
+	}
+	js_compiled->Set(js_file, wrapped_script);
+	return true;
+}
+
+std::vector<std::string> package::dependencies(v8::Isolate* isolate, std::string const& name) const
+{
+	std::vector<std::string> result;
+	auto const deps = contents().dependencies.find(file_name(isolate, v8pp::to_v8(isolate, name), true));
+	if (deps != contents().dependencies.end())
+	{
+		for (path const& file : deps->second)
+		{
+			result.emplace_back(file.str());
 		}
-		sources.emplace(file.relative_to(base), std::move(content));
 	}
-	modules.emplace(id, p.base() / main.relative_to(p));
+	return result;
+}
+
+void package::prefetch_dependencies(v8::Isolate* isolate, path const& file)
+{
+	if (!prefetch_)
+	{
+		return;
+	}
+	auto const deps = contents().dependencies.find(file);
+	if (deps == contents().dependencies.end())
+	{
+		return;
+	}
+
+	// compile the files required by `file` in one batch before its evaluation,
+	// compilation errors are reported later by require() of a failed file
+	v8::HandleScope scope(isolate);
+	for (path const& dep : deps->second)
+	{
+		v8::TryCatch try_catch;
+		compile_file(isolate, dep);
+	}
 }
 
-void package::load_file(modules_map& modules, sources_map& sources, std::string const& id, path const& p)
+std::vector<std::string> package::profile() const
 {
-	sources.emplace(p.base(), p.content());
-	modules.emplace(id, p.base());
+	std::vector<std::string> result;
+	result.reserve(profile_.size());
+	for (path const& file : profile_)
+	{
+		result.emplace_back(file.str());
+	}
+	return result;
+}
+
+std::vector<std::string> package::files() const
+{
+	std::vector<std::string> result;
+	result.reserve(contents().source_count() + contents().blobs.size());
+	for (auto const& kv : contents().source_list())
+	{
+		result.emplace_back(kv.first.str());
+	}
+	for (auto const& kv : contents().blobs)
+	{
+		result.emplace_back(kv.first.str());
+	}
+	for (auto const& kv : contents().code_cache)
+	{
+		result.emplace_back(kv.first.str());
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+namespace {
+
+// External V8 string with one-byte content in package memory
+class external_string : public v8::String::ExternalOneByteStringResource
+{
+public:
+	external_string(std::shared_ptr<char const> const& storage, string_ref content)
+		: storage_(storage)
+		, content_(content)
+	{
+	}
+
+	char const* data() const override { return content_.data(); }
+	size_t length() const override { return content_.size(); }
+
+private:
+	std::shared_ptr<char const> storage_;
+	string_ref content_;
+};
+
+bool is_ascii(string_ref str)
+{
+	return std::all_of(str.begin(), str.end(), [](char ch) { return (ch & 0x80) == 0; });
+}
+
+} // unnamed namespace
+
+// Buffer with a copy of the package memory: buffers are writable, while
+// the package memory is shared by packages and may be mapped read-only
+static v8::Local<v8::Object> copy_buffer(v8::Isolate* isolate, string_ref content)
+{
+#if NODE_MAJOR_VERSION < 3
+	return node::Buffer::New(isolate, content.data(), content.size());
+#else
+	return node::Buffer::Copy(isolate, content.data(), content.size()).ToLocalChecked();
+#endif
+}
+
+path package::file_name(v8::Isolate* isolate, v8::Local<v8::Value> name, bool allow_bytecode) const
+{
+	path result = v8pp::from_v8<path>(isolate, name);
+	auto const module = contents().modules.find(result.str());
+	if (module != contents().modules.end())
+	{
+		result = module->second;
+	}
+	if (contents().code_cache.find(result) != contents().code_cache.end())
+	{
+		if (allow_bytecode)
+		{
+			return result;
+		}
+		throw std::runtime_error("only bytecode is stored for " + result.str());
+	}
+	if (!contents().has_source(result) && contents().blobs.find(result) == contents().blobs.end())
+	{
+		throw std::runtime_error("no such file in package: " + result.str());
+	}
+	return result;
+}
+
+void package::read_file(v8::FunctionCallbackInfo<v8::Value> const& args)
+{
+	v8::Isolate* isolate = args.GetIsolate();
+
+	path const name = file_name(isolate, args[0]);
+	std::string const encoding = v8pp::from_v8<std::string>(isolate, args[1], "");
+
+	v8::EscapableHandleScope scope(isolate);
+	v8::Local<v8::Value> result;
+
+	auto const blob = contents().blobs.find(name);
+	if (blob != contents().blobs.end())
+	{
+		// blob is decrypted into a new buffer
+		if (blob->second.size > node::Buffer::kMaxLength)
+		{
+			throw std::runtime_error(name.str() + " is too large for a Buffer, use read() or createReadStream()");
+		}
+		std::string content(static_cast<size_t>(blob->second.size), 0);
+		{
+			stats_timer timer(stats_, stats_.blob_decrypt_ns);
+			trace::span span("decrypt", name.str());
+			contents().read_blob(blob->second, 0, content.size(), &content[0]);
+			++stats_.blob_reads;
+		}
+		if (encoding.empty())
+		{
+			result = string_buffer(isolate, std::move(content));
+		}
+		else if (encoding == "utf8" || encoding == "utf-8")
+		{
+			result = v8pp::to_v8(isolate, content.data(), static_cast<int>(content.size()));
+		}
+		else if (encoding == "latin1" || encoding == "binary")
+		{
+			result = v8::String::NewFromOneByte(isolate, reinterpret_cast<uint8_t const*>(content.data()),
+				v8::String::kNormalString, static_cast<int>(content.size()));
+		}
+		else
+		{
+			throw std::invalid_argument("unsupported encoding " + encoding);
+		}
+		args.GetReturnValue().Set(scope.Escape(result));
+		return;
+	}
+
+	// .js sources are wiped after compile, only other files stay in package memory
+	bool const resident = (name.extension() != ".js");
+	std::string source;
+	string_ref content;
+	if (resident)
+	{
+		contents().find_source(name, content);
+	}
+	else
+	{
+		contents().copy_source(name, source);
+		content = source;
+	}
+	bool const latin1 = (encoding == "latin1" || encoding == "binary");
+	if (encoding.empty())
+	{
+		result = copy_buffer(isolate, content);
+	}
+	else if (encoding == "utf8" || encoding == "utf-8" || latin1)
+	{
+		if (content.size() > static_cast<size_t>(v8::String::kMaxLength))
+		{
+			throw std::runtime_error(name.str() + " is too large for a string");
+		}
+		// one-byte external string may be used for Latin-1 and for ASCII
+		// in UTF-8, other UTF-8 content is copied into V8 heap
+		if (resident && (latin1 || is_ascii(content)))
+		{
+			external_string* str = new external_string(contents().storage, content);
+#if NODE_MAJOR_VERSION < 3
+			result = v8::String::NewExternal(isolate, str);
+#else
+			result = v8::String::NewExternalOneByte(isolate, str).ToLocalChecked();
+#endif
+		}
+		else if (latin1)
+		{
+			result = v8::String::NewFromOneByte(isolate, reinterpret_cast<uint8_t const*>(content.data()),
+				v8::String::kNormalString, static_cast<int>(content.size()));
+		}
+		else
+		{
+			result = v8pp::to_v8(isolate, content.data(), static_cast<int>(content.size()));
+		}
+	}
+	else
+	{
+		throw std::invalid_argument("unsupported encoding " + encoding);
+	}
+	drop_plaintext(source);
+	args.GetReturnValue().Set(scope.Escape(result));
+}
+
+void package::read(v8::FunctionCallbackInfo<v8::Value> const& args)
+{
+	v8::Isolate* isolate = args.GetIsolate();
+
+	path const name = file_name(isolate, args[0]);
+	uint64_t const offset = v8pp::from_v8<uint64_t>(isolate, args[1], 0);
+	size_t const length = std::min<size_t>(v8pp::from_v8<size_t>(isolate, args[2]), node::Buffer::kMaxLength);
+
+	v8::EscapableHandleScope scope(isolate);
+	v8::Local<v8::Object> result;
+
+	auto const blob = contents().blobs.find(name);
+	if (blob != contents().blobs.end())
+	{
+		// decrypt only the blocks covering the range
+		std::string data(static_cast<size_t>(std::min<uint64_t>(length,
+			offset < blob->second.size? blob->second.size - offset : 0)), 0);
+		{
+			stats_timer timer(stats_, stats_.blob_decrypt_ns);
+			trace::span span("decrypt", name.str());
+			contents().read_blob(blob->second, offset, data.size(), &data[0]);
+			++stats_.blob_reads;
+		}
+		result = string_buffer(isolate, std::move(data));
+	}
+	else
+	{
+		std::string source;
+		string_ref content;
+		if (name.extension() != ".js")
+		{
+			contents().find_source(name, content);
+		}
+		else
+		{
+			contents().copy_source(name, source);
+			content = source;
+		}
+		size_t const begin = static_cast<size_t>(std::min<uint64_t>(offset, content.size()));
+		size_t const end = begin + std::min(length, content.size() - begin);
+		result = copy_buffer(isolate, string_ref(content.data() + begin, end - begin));
+		drop_plaintext(source);
+	}
+	args.GetReturnValue().Set(scope.Escape(result));
 }
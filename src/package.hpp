@@ -13,46 +13,205 @@
 #include <vector>
 #include <unordered_map>
 #include <tuple>
+#include <list>
+#include <map>
 #include <stack>
+#include <memory>
 
 #include <v8.h>
 
+#include <v8pp/convert.hpp>
+
+#include "archive.hpp"
 #include "path.hpp"
 
 class package
 {
 public:
-	static v8::UniquePersistent<v8::Object> node_module;
-	static v8::UniquePersistent<v8::Function> node_require;
-	static v8::UniquePersistent<v8::Object> node_crypto;
+	// Addon state for each isolate (main thread and worker threads)
+	struct isolate_state
+	{
+		v8::UniquePersistent<v8::Object> node_module;
+		v8::UniquePersistent<v8::Function> node_require;
+	};
+
+	static isolate_state& init_state(v8::Isolate* isolate);
+	static isolate_state& state(v8::Isolate* isolate);
+	static void release_state(v8::Isolate* isolate);
 
 	static void gen_auth(v8::FunctionCallbackInfo<v8::Value> const& args);
 	static void make(v8::FunctionCallbackInfo<v8::Value> const& args);
 	static void load(v8::FunctionCallbackInfo<v8::Value> const& args);
+	static void attach(v8::FunctionCallbackInfo<v8::Value> const& args);
+	static void load_shared(v8::FunctionCallbackInfo<v8::Value> const& args);
+
+	// package metadata from a package file, decrypting only its small index
+	static void inspect(v8::FunctionCallbackInfo<v8::Value> const& args);
+
+	// delta between package files, see delta.hpp
+	static void diff(v8::FunctionCallbackInfo<v8::Value> const& args);
 
 	void require(v8::FunctionCallbackInfo<v8::Value> const& args);
+	void read_file(v8::FunctionCallbackInfo<v8::Value> const& args);
+	void read(v8::FunctionCallbackInfo<v8::Value> const& args);
+
+	// compile module `name` or a .js file in the package ahead of require(),
+	// return false if it is already compiled or loaded
+	void compile(v8::FunctionCallbackInfo<v8::Value> const& args);
+
+	// static require() dependencies of module `name` or a file in the package
+	std::vector<std::string> dependencies(v8::Isolate* isolate, std::string const& name) const;
+
+	// compile dependencies of a module in one batch on its require(), off by default
+	bool prefetch() const { return prefetch_; }
+	void set_prefetch(bool prefetch) { prefetch_ = prefetch; }
 
-	uint16_t serial() const { return serial_number_; }
+	// register the package contents to attach from other threads
+	uint32_t share();
+
+	// copy the package contents into sealed shared memory for child processes,
+	// return its close-on-exec file descriptor
+	int share_memory();
+
+	uint16_t serial() const { return contents().serial_number; }
 
 	std::vector<std::string> names() const;
+	std::vector<std::string> files() const;
+
+	// metadata queries for module names and file paths, not decrypting file contents
+	bool has(std::string const& name) const;
+	v8::Local<v8::Object> stat(v8::Isolate* isolate, std::string const& name) const;
+	void list(v8::FunctionCallbackInfo<v8::Value> const& args);
+
+	// files loaded by require() in first-use order
+	std::vector<std::string> profile() const;
+
+	// load and require() statistics
+	v8::Local<v8::Object> stats(v8::Isolate* isolate) const;
+	bool stats_enabled() const { return stats_.enabled; }
+	void set_stats_enabled(bool enabled) { stats_.enabled = enabled; }
+
+	// memory budget mode: exports of evictable modules over the limit
+	// of their source size are held weakly, 0 is no limit
+	uint64_t memory_limit() const { return memory_limit_; }
+	void set_memory_limit(uint64_t limit);
+
+	// release the package contents and modules, the package can't be used after
+	~package();
+	void close();
+	bool closed() const { return !archive_; }
 
 private:
-	uint16_t serial_number_;
+	static void make_bytecode(v8::Isolate* isolate, archive& ar);
+	static v8::Local<v8::Object> create(v8::Isolate* isolate, std::shared_ptr<archive const> ar);
 
 	v8::UniquePersistent<v8::Object> js_modules_;
+	v8::UniquePersistent<v8::Object> js_compiled_;
+	v8::UniquePersistent<v8::Array> js_bundle_;
 
-	using sources_map = std::unordered_map<path, std::string>;
-	sources_map sources_;
+	// decrypted contents, immutable and shared between isolates
+	std::shared_ptr<archive const> archive_;
+	archive const& contents() const;
 
-	using modules_map = std::unordered_map<std::string, path>;
-	modules_map modules_;
+	// native memory of the archive reported to V8, once for all packages
+	// of the isolate sharing the archive
+	v8::Isolate* isolate_ = nullptr;
+	bool memory_counted_ = false;
+	void count_memory(bool add);
+	int shared_fd_ = -1;
 
-	std::stack<path> require_dir_stack_;
+	// Buffer or ArrayBuffer the package was loaded from, blobs are read from it
+	v8::UniquePersistent<v8::Value> input_;
+
+	// counters are always collected, timings only when enabled
+	struct module_stats
+	{
+		uint64_t compile_ns = 0;
+		uint64_t execute_ns = 0;
+	};
+	struct stats_data
+	{
+		bool enabled = false;
+		uint64_t requires = 0;
+		uint64_t cache_hits = 0;
+		uint64_t fallbacks = 0;
+		uint64_t compiled = 0;
+		uint64_t compile_ns = 0;
+		uint64_t executed = 0;
+		uint64_t execute_ns = 0;
+		uint64_t blob_reads = 0;
+		uint64_t blob_decrypt_ns = 0;
+		uint64_t evictions = 0;
+		std::map<path, module_stats> modules;
+	};
+	class stats_timer;
+	stats_data stats_;
 
-	static void load_dir(v8::Isolate* isolate, modules_map& modules, sources_map& sources, std::string const& id, path const& p);
-	static void load_file(modules_map& modules, sources_map& sources, std::string const& id, path const& p);
+	// evictable modules, most recently used first
+	struct evictable_module
+	{
+		path file;
+		uint64_t size = 0; // plain source size, module cost in the memory limit
+		bool weak = false;
+		v8::UniquePersistent<v8::Value> exports;
+	};
+	std::list<evictable_module> evictable_;
+	std::unordered_map<path, std::list<evictable_module>::iterator> evictable_index_;
+	uint64_t memory_limit_ = 0;
+	uint64_t evictable_held_ = 0;
 
+	v8::Local<v8::Value> require_evictable(v8::Isolate* isolate, std::string const& id, path const& file);
+	void evict();
+
+	std::stack<path> require_dir_stack_;
+	std::vector<path> profile_;
+
+	bool prefetch_ = false;
+	bool compile_file(v8::Isolate* isolate, path const& file);
+	void prefetch_dependencies(v8::Isolate* isolate, path const& file);
+	v8::Local<v8::Value> run_script(v8::Isolate* isolate, std::string const& origin_name,
+		string_ref const& source);
+	v8::Local<v8::Function> module_function(v8::Isolate* isolate, std::string const& origin_name,
+		path const& file, string_ref const& source);
+	v8::Local<v8::Function> compile_cached(v8::Isolate* isolate, path const& file,
+		archive::compiled_module const& module);
+	v8::Local<v8::Function> bundled_module(v8::Isolate* isolate, path const& file);
+	v8::Local<v8::Function> compile_module(v8::Isolate* isolate, std::string const& origin_name,
+		string_ref const& source);
+	// `source` is wiped after compile
 	v8::Local<v8::Value> require_module(v8::Isolate* isolate, std::string const& id,
-		path const& file, std::string const& source);
+		path const& file, std::string& source);
 	v8::Local<v8::Value> require_original(v8::Isolate* isolate, std::string const& id);
+
+	path file_name(v8::Isolate* isolate, v8::Local<v8::Value> name, bool allow_bytecode = false) const;
+};
+
+namespace v8pp {
+
+template<>
+struct convert<path>
+{
+	using from_type = path;
+	using to_type = v8::Handle<v8::String>;
+
+	static bool is_valid(v8::Isolate*, v8::Handle<v8::Value> value)
+	{
+		return !value.IsEmpty() && value->IsString();
+	}
+
+	static from_type from_v8(v8::Isolate* isolate, v8::Handle<v8::Value> value)
+	{
+		if (!is_valid(isolate, value))
+		{
+			throw std::invalid_argument("expected path string");
+		}
+		return path(convert<std::string>::from_v8(isolate, value));
+	}
+
+	static to_type to_v8(v8::Isolate* isolate, path const& value)
+	{
+		return convert<std::string>::to_v8(isolate, value.str());
+	}
 };
+
+} // namespace v8pp
@@ -0,0 +1,184 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#include "package_info.hpp"
+#include "binary_io.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+char const* package_info::kind_name(file_kind kind)
+{
+	switch (kind)
+	{
+	case SOURCE:    return "source";
+	case BUNDLED:   return "bundled";
+	case BLOB:      return "blob";
+	case EVICTABLE: return "evictable";
+	case BYTECODE:  return "bytecode";
+	}
+	return "unknown";
+}
+
+std::string package_info::file::hash_hex() const
+{
+	static char const digits[] = "0123456789abcdef";
+	std::string result;
+	result.reserve(hash.size() * 2);
+	for (unsigned char ch : hash)
+	{
+		result += digits[ch >> 4];
+		result += digits[ch & 0xF];
+	}
+	return result;
+}
+
+std::string package_info::build(modules_list modules, std::string const& v8_version,
+	std::vector<file> const& files)
+{
+	std::sort(modules.begin(), modules.end());
+	std::vector<file const*> sorted;
+	sorted.reserve(files.size());
+	for (file const& f : files)
+	{
+		sorted.push_back(&f);
+	}
+	std::sort(sorted.begin(), sorted.end(),
+		[](file const* lhs, file const* rhs) { return lhs->name < rhs->name; });
+
+	// file records are addressed by the flat index value offset,
+	// the value size is the plain file size
+	std::string records;
+	binary_writer records_out(records);
+	std::vector<std::pair<std::string, flat_index::entry>> index;
+	index.reserve(files.size());
+	for (file const* f : sorted)
+	{
+		flat_index::entry const e = { records.size(), f->size };
+		index.emplace_back(f->name.str(), e);
+		records_out.write(static_cast<uint8_t>(f->kind));
+		records_out.write(f->stored_size);
+		records_out.write_bytes(f->hash);
+	}
+
+	std::string result;
+	binary_writer out(result);
+	out.write(static_cast<uint32_t>(modules.size()));
+	for (auto const& module : modules)
+	{
+		out.write_bytes(module.first);
+		out.write_bytes(module.second.str());
+	}
+	out.write_bytes(v8_version);
+	std::string const files_index = flat_index::build(std::move(index));
+	out.write(static_cast<uint64_t>(files_index.size()));
+	result += files_index;
+	out.write(static_cast<uint64_t>(records.size()));
+	result += records;
+	return result;
+}
+
+package_info::package_info(std::string data)
+	: data_(std::make_shared<std::string const>(std::move(data)))
+{
+	binary_reader in(data_->data(), data_->size());
+	uint32_t const modules_count = in.read<uint32_t>();
+	modules_.reserve(modules_count);
+	names_.reserve(modules_count);
+	for (uint32_t i = 0; i != modules_count; ++i)
+	{
+		std::string id = in.read_string();
+		names_.push_back(id);
+		modules_.emplace_back(std::move(id), in.read_string());
+	}
+	v8_version_ = in.read_string();
+
+	uint64_t const index_size = in.read<uint64_t>();
+	if (index_size > in.left())
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	files_ = flat_index(string_ref(in.take(static_cast<size_t>(index_size)), static_cast<size_t>(index_size)));
+	uint64_t const records_size = in.read<uint64_t>();
+	if (records_size > in.left())
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	records_ = string_ref(in.take(static_cast<size_t>(records_size)), static_cast<size_t>(records_size));
+}
+
+package_info::file package_info::record(path name, flat_index::entry e) const
+{
+	if (e.offset > records_.size())
+	{
+		throw std::runtime_error("Package invalid format");
+	}
+	binary_reader in(records_.data() + e.offset, records_.size() - static_cast<size_t>(e.offset));
+	file result;
+	result.name = std::move(name);
+	result.kind = static_cast<file_kind>(in.read<uint8_t>());
+	result.size = e.size;
+	result.stored_size = in.read<uint64_t>();
+	result.hash = in.read_string();
+	return result;
+}
+
+bool package_info::find(path const& name, file& result) const
+{
+	flat_index::entry e;
+	if (!files_.find(name.str(), e))
+	{
+		return false;
+	}
+	result = record(name, e);
+	return true;
+}
+
+std::vector<package_info::file> package_info::list(std::string const& prefix) const
+{
+	// names with the prefix follow each other in sorted order
+	size_t first = 0, last = files_.size();
+	for (size_t count = last; count > 0; )
+	{
+		size_t const step = count / 2;
+		if (files_.key(first + step) < prefix)
+		{
+			first += step + 1;
+			count -= step + 1;
+		}
+		else
+		{
+			count = step;
+		}
+	}
+	size_t lo = first;
+	for (size_t count = last - first; count > 0; )
+	{
+		size_t const step = count / 2;
+		if (files_.key(lo + step).compare(0, prefix.size(), prefix) == 0)
+		{
+			lo += step + 1;
+			count -= step + 1;
+		}
+		else
+		{
+			count = step;
+		}
+	}
+	last = lo;
+
+	std::vector<file> result;
+	std::vector<std::string> names = files_.keys(first, last);
+	result.reserve(names.size());
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		result.push_back(record(names[i], files_.value(first + i)));
+	}
+	return result;
+}
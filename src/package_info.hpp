@@ -0,0 +1,81 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "flat_index.hpp"
+#include "path.hpp"
+
+// Package metadata: module names and stored files with their sizes and
+// content hashes. Saved as a small separately encrypted index in the package
+// header, so it can be read without decrypting the package contents.
+class package_info
+{
+public:
+	enum file_kind : uint8_t { SOURCE, BUNDLED, BLOB, EVICTABLE, BYTECODE };
+	static char const* kind_name(file_kind kind);
+
+	struct file
+	{
+		path name;
+		file_kind kind;
+		uint64_t size;        // plain content size
+		uint64_t stored_size; // size in the package: with blob block tags, or of the code cache
+		std::string hash;     // SHA-256 of plain content, empty if unknown
+
+		// hash as a hex string
+		std::string hash_hex() const;
+
+		// stored to plain size ratio, packages are not compressed so it shows
+		// the storage overhead of blob blocks or the code cache to source ratio
+		double ratio() const { return size? static_cast<double>(stored_size) / size : 1.0; }
+	};
+
+	using modules_list = std::vector<std::pair<std::string, path>>;
+
+	// serialized metadata
+	static std::string build(modules_list modules, std::string const& v8_version,
+		std::vector<file> const& files);
+
+	package_info() = default;
+
+	// metadata from build() result
+	explicit package_info(std::string data);
+
+	// module names with their main files, sorted by name
+	modules_list const& modules() const { return modules_; }
+	std::vector<std::string> const& names() const { return names_; }
+
+	std::string const& v8_version() const { return v8_version_; }
+
+	size_t file_count() const { return files_.size(); }
+	bool find(path const& name, file& result) const;
+
+	// files with names starting with `prefix`, sorted by name
+	std::vector<file> list(std::string const& prefix = std::string()) const;
+
+	// serialized metadata
+	string_ref data() const { return data_? string_ref(*data_) : string_ref(); }
+
+private:
+	file record(path name, flat_index::entry e) const;
+
+	std::shared_ptr<std::string const> data_;
+	modules_list modules_;
+	std::vector<std::string> names_;
+	std::string v8_version_;
+	flat_index files_;
+	string_ref records_;
+};
@@ -12,8 +12,15 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <fcntl.h>
+
 #include <cassert>
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
 #include <vector>
 #include <fstream>
 
@@ -88,6 +95,77 @@ bool path::is_file() const
 	return stat(str_.c_str(), &s) == 0 && (s.st_mode & S_IFREG);
 }
 
+uint64_t path::size() const
+{
+	struct stat s;
+	if (stat(str_.c_str(), &s) != 0)
+	{
+		throw std::runtime_error("can't stat " + str_);
+	}
+	return s.st_size;
+}
+
+bool path::is_same_file(path const& other) const
+{
+	struct stat s1, s2;
+	if (stat(str_.c_str(), &s1) != 0 || stat(other.str_.c_str(), &s2) != 0)
+	{
+		return false;
+	}
+#ifdef _WIN32
+	// no inode numbers, compare normalized paths
+	return str_ == other.str_;
+#else
+	return s1.st_dev == s2.st_dev && s1.st_ino == s2.st_ino;
+#endif
+}
+
+void path::rename(path const& target) const
+{
+#ifdef _WIN32
+	// rename() doesn't replace existing files on Windows
+	std::remove(target.c_str());
+#endif
+	if (std::rename(str_.c_str(), target.c_str()) != 0)
+	{
+		throw std::runtime_error("can't rename " + str_ + " to " + target.str_);
+	}
+}
+
+// create a new file, fail if it exists
+static bool create_new_file(char const* name)
+{
+#ifdef _WIN32
+	int const fd = _open(name, _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY, _S_IREAD | _S_IWRITE);
+	return fd >= 0 && _close(fd) == 0;
+#else
+	int const fd = ::open(name, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0666);
+	return fd >= 0 && ::close(fd) == 0;
+#endif
+}
+
+path path::create_unique() const
+{
+	// a random suffix with a process-wide counter, created exclusively
+	// to retry on collisions with other processes
+	static std::atomic<uint32_t> counter(std::random_device{}());
+	for (unsigned attempt = 0; attempt < 100; ++attempt)
+	{
+		char suffix[16];
+		snprintf(suffix, sizeof(suffix), ".%08x", static_cast<unsigned>(counter++ * 2654435761u));
+		path result(str_ + suffix);
+		if (create_new_file(result.c_str()))
+		{
+			return result;
+		}
+		if (errno != EEXIST)
+		{
+			break;
+		}
+	}
+	throw std::runtime_error("can't create a file " + str_ + ".*");
+}
+
 void path::normalize()
 {
 	if (str_.empty()) return;
@@ -130,7 +208,7 @@ void path::add_extension(std::string const& ext)
 	string& base = p.second.str_;
 	if (!base.empty() && base.find_last_of('.') == string::npos)
 	{
-		str_ = p.first.str_ + path_sep + base + ext;
+		str_ = (str_.find_last_of(path_sep) == string::npos? base : p.first.str_ + path_sep + base) + ext;
 	}
 }
 
@@ -154,6 +232,53 @@ path path::relative_to(path const& base) const
 	return path(join(result));
 }
 
+// glob match of a single path part
+static bool match_part(char const* pattern, char const* str)
+{
+	for (; *pattern; ++pattern, ++str)
+	{
+		if (*pattern == '*')
+		{
+			for (char const* rest = str; ; ++rest)
+			{
+				if (match_part(pattern + 1, rest)) return true;
+				if (!*rest) return false;
+			}
+		}
+		if (!*str || (*pattern != '?' && *pattern != *str)) return false;
+	}
+	return !*str;
+}
+
+static bool match_parts(strings::const_iterator pattern, strings::const_iterator pattern_end,
+	strings::const_iterator parts, strings::const_iterator parts_end)
+{
+	for (; pattern != pattern_end; ++pattern, ++parts)
+	{
+		if (*pattern == "**")
+		{
+			for (auto rest = parts; ; ++rest)
+			{
+				if (match_parts(pattern + 1, pattern_end, rest, parts_end)) return true;
+				if (rest == parts_end) return false;
+			}
+		}
+		if (parts == parts_end || !match_part(pattern->c_str(), parts->c_str())) return false;
+	}
+	return parts == parts_end;
+}
+
+bool path::match(std::string const& pattern) const
+{
+	strings const pattern_parts = split(path(pattern).str_);
+	if (pattern_parts.size() == 1)
+	{
+		return match_part(pattern_parts.front().c_str(), base().c_str());
+	}
+	strings const parts = split(str_);
+	return match_parts(pattern_parts.begin(), pattern_parts.end(), parts.begin(), parts.end());
+}
+
 std::vector<path> path::list_files() const
 {
 	assert(is_dir());
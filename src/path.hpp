@@ -9,11 +9,12 @@
 //
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <utility>
 
-#include <v8pp/convert.hpp>
+#include <functional>
 
 class path
 {
@@ -24,12 +25,23 @@ public:
 
 	bool operator==(path const& rhs) const { return str_ == rhs.str_; }
 	bool operator!=(path const& rhs) const { return str_ != rhs.str_; }
+	bool operator<(path const& rhs) const { return str_ < rhs.str_; }
 
 	template<typename Archive>
 	void serialize(Archive& ar) { ar & str_; }
 
 	bool is_dir() const;
 	bool is_file() const;
+	uint64_t size() const;
+
+	// whether both paths name the same existing file
+	bool is_same_file(path const& other) const;
+
+	// rename the file to `target`, replacing an existing one
+	void rename(path const& target) const;
+
+	// create a new empty file named as this path with a unique suffix
+	path create_unique() const;
 
 	bool empty() const { return str_.empty(); }
 	void clear() { str_.clear(); }
@@ -48,6 +60,10 @@ public:
 
 	path relative_to(path const& base) const;
 
+	// match a glob pattern with `*` and `?` in a path part and `**` for any
+	// number of parts, a pattern without separators matches the base name
+	bool match(std::string const& pattern) const;
+
 	std::vector<path> list_files() const;
 	std::string content() const;
 	static path current();
@@ -70,33 +86,3 @@ struct hash<path> : hash<std::string>
 };
 
 } // std
-
-namespace v8pp {
-
-template<>
-struct convert<path>
-{
-	using from_type = path;
-	using to_type = v8::Handle<v8::String>;
-
-	static bool is_valid(v8::Isolate*, v8::Handle<v8::Value> value)
-	{
-		return !value.IsEmpty() && value->IsString();
-	}
-
-	static from_type from_v8(v8::Isolate* isolate, v8::Handle<v8::Value> value)
-	{
-		if (!is_valid(isolate, value))
-		{
-			throw std::invalid_argument("expected path string");
-		}
-		return path(convert<std::string>::from_v8(isolate, value));
-	}
-
-	static to_type to_v8(v8::Isolate* isolate, path const& value)
-	{
-		return convert<std::string>::to_v8(isolate, value.str());
-	}
-};
-
-} // namespace v8pp
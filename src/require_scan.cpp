@@ -0,0 +1,180 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#include "require_scan.hpp"
+
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+bool is_ident(char ch)
+{
+	return isalnum(static_cast<unsigned char>(ch)) || ch == '_' || ch == '$' || (ch & 0x80);
+}
+
+bool is_keyword(char const* begin, char const* end)
+{
+	static char const* const keywords[] = { "return", "typeof", "instanceof", "in", "of",
+		"new", "delete", "void", "throw", "case", "do", "else", "yield", "await" };
+	for (char const* keyword : keywords)
+	{
+		if (strlen(keyword) == size_t(end - begin) && memcmp(keyword, begin, end - begin) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+class scanner
+{
+public:
+	explicit scanner(string_ref source)
+		: pos_(source.data())
+		, end_(source.data() + source.size())
+	{
+	}
+
+	std::vector<std::string> run()
+	{
+		std::vector<std::string> result;
+		// last significant char, to tell a regular expression from a division
+		char prev = 0;
+		while (pos_ != end_)
+		{
+			char const ch = *pos_;
+			if (isspace(static_cast<unsigned char>(ch)))
+			{
+				++pos_;
+			}
+			else if (ch == '/' && next() == '/')
+			{
+				skip_until("\n");
+			}
+			else if (ch == '/' && next() == '*')
+			{
+				pos_ += 2;
+				skip_until("*/");
+			}
+			else if (ch == '\'' || ch == '"' || ch == '`')
+			{
+				skip_string(ch);
+				prev = ch;
+			}
+			else if (ch == '/' && !(is_ident(prev) || prev == ')' || prev == ']'))
+			{
+				skip_regexp();
+				prev = 'r';
+			}
+			else if (is_ident(ch))
+			{
+				char const* const begin = pos_;
+				while (pos_ != end_ && is_ident(*pos_)) ++pos_;
+				std::string name;
+				if (prev != '.' && pos_ - begin == 7 && memcmp(begin, "require", 7) == 0
+					&& read_call_literal(name))
+				{
+					result.emplace_back(std::move(name));
+					prev = ')';
+				}
+				else
+				{
+					// a regular expression may follow a keyword
+					prev = (is_keyword(begin, pos_)? '(' : 'a');
+				}
+			}
+			else
+			{
+				prev = ch;
+				++pos_;
+			}
+		}
+		return result;
+	}
+
+private:
+	char next() const { return pos_ + 1 != end_? pos_[1] : 0; }
+
+	void skip_space()
+	{
+		while (pos_ != end_ && isspace(static_cast<unsigned char>(*pos_))) ++pos_;
+	}
+
+	void skip_until(char const* str)
+	{
+		size_t const len = strlen(str);
+		while (pos_ != end_ && (size_t(end_ - pos_) < len || memcmp(pos_, str, len) != 0)) ++pos_;
+		pos_ = (size_t(end_ - pos_) < len? end_ : pos_ + len);
+	}
+
+	void skip_string(char quote)
+	{
+		for (++pos_; pos_ != end_ && *pos_ != quote; ++pos_)
+		{
+			if (*pos_ == '\\' && pos_ + 1 != end_) ++pos_;
+			else if (*pos_ == '\n' && quote != '`') break;
+		}
+		if (pos_ != end_) ++pos_;
+	}
+
+	void skip_regexp()
+	{
+		bool in_class = false;
+		for (++pos_; pos_ != end_ && *pos_ != '\n'; ++pos_)
+		{
+			if (*pos_ == '\\' && pos_ + 1 != end_) ++pos_;
+			else if (*pos_ == '[') in_class = true;
+			else if (*pos_ == ']') in_class = false;
+			else if (*pos_ == '/' && !in_class) { ++pos_; break; }
+		}
+		while (pos_ != end_ && is_ident(*pos_)) ++pos_; // flags
+	}
+
+	// `( 'literal' )` after require, the position is restored on mismatch
+	bool read_call_literal(std::string& name)
+	{
+		char const* const start = pos_;
+		skip_space();
+		if (pos_ != end_ && *pos_ == '(')
+		{
+			++pos_;
+			skip_space();
+			if (pos_ != end_ && (*pos_ == '\'' || *pos_ == '"'))
+			{
+				char const quote = *pos_++;
+				char const* const begin = pos_;
+				while (pos_ != end_ && *pos_ != quote && *pos_ != '\\' && *pos_ != '\n') ++pos_;
+				if (pos_ != end_ && *pos_ == quote)
+				{
+					name.assign(begin, pos_);
+					++pos_;
+					skip_space();
+					if (pos_ != end_ && *pos_ == ')')
+					{
+						++pos_;
+						return true;
+					}
+				}
+			}
+		}
+		pos_ = start;
+		return false;
+	}
+
+	char const* pos_;
+	char const* const end_;
+};
+
+} // unnamed namespace
+
+std::vector<std::string> scan_requires(string_ref source)
+{
+	return scanner(source).run();
+}
@@ -0,0 +1,19 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "string_ref.hpp"
+
+// Names in static `require('literal')` calls of a JavaScript source,
+// in order of appearance. Comments, strings and regular expressions are skipped.
+std::vector<std::string> scan_requires(string_ref source);
@@ -0,0 +1,41 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <cstring>
+#include <string>
+
+// Non-owning reference to a char sequence in package memory
+class string_ref
+{
+public:
+	string_ref() : data_(nullptr), size_(0) {}
+	string_ref(char const* data, size_t size) : data_(data), size_(size) {}
+	string_ref(std::string const& str) : data_(str.data()), size_(str.size()) {}
+
+	char const* data() const { return data_; }
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+
+	char const* begin() const { return data_; }
+	char const* end() const { return data_ + size_; }
+
+	std::string str() const { return std::string(data_, size_); }
+
+	bool operator==(string_ref const& rhs) const
+	{
+		return size_ == rhs.size_ && (size_ == 0 || memcmp(data_, rhs.data_, size_) == 0);
+	}
+	bool operator!=(string_ref const& rhs) const { return !(*this == rhs); }
+
+private:
+	char const* data_;
+	size_t size_;
+};
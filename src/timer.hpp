@@ -0,0 +1,25 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Monotonic high resolution time in nanoseconds, for statistics
+inline uint64_t monotonic_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline double ns_to_ms(uint64_t ns)
+{
+	return ns / 1e6;
+}
@@ -0,0 +1,329 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#include "trace.hpp"
+#include "timer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace trace {
+
+namespace {
+
+struct event
+{
+	char const* name;
+	char detail[detail_size];
+	uint64_t id;
+	uint64_t parent;
+	uint64_t start;
+	uint64_t duration;
+};
+
+// events [0, size) are published by the owner thread with release ordering
+// and never change after that, the next block is published when this one is full
+struct block
+{
+	static size_t const capacity = 1024;
+
+	event events[capacity];
+	std::atomic<size_t> size;
+	std::atomic<block*> next;
+
+	block() : size(0), next(nullptr) {}
+};
+
+void delete_blocks(block* b)
+{
+	while (b)
+	{
+		block* const next = b->next.load(std::memory_order_relaxed);
+		delete b;
+		b = next;
+	}
+}
+
+// written only by the owner thread, export reads the published events
+struct thread_buffer
+{
+	// events over the limit are dropped until the next start()
+	static size_t const max_blocks = 64;
+
+	uint32_t tid;
+	std::atomic<block*> head;
+	thread_buffer* next;
+
+	// owner thread state
+	block* tail;
+	size_t blocks;
+	unsigned generation;
+	// blocks of previous traces, freed when no export reads them
+	std::vector<block*> retired;
+};
+
+// buffers are never freed, events of finished threads stay exportable
+std::atomic<thread_buffer*> buffers(nullptr);
+std::atomic<uint32_t> next_tid(1);
+std::atomic<bool> active(false);
+std::atomic<uint64_t> start_time(0);
+// incremented on start(), an owner thread starts new blocks on its next append
+std::atomic<unsigned> generation(0);
+// count of events_json() calls in progress
+std::atomic<unsigned> readers(0);
+
+thread_local thread_buffer* this_buffer = nullptr;
+thread_local span* current_span = nullptr;
+thread_local uint64_t last_span_id = 0;
+
+thread_buffer& get_buffer()
+{
+	if (!this_buffer)
+	{
+		thread_buffer* buf = new thread_buffer;
+		buf->tid = next_tid++;
+		buf->tail = new block;
+		buf->head.store(buf->tail, std::memory_order_relaxed);
+		buf->blocks = 1;
+		buf->generation = generation.load(std::memory_order_relaxed);
+		buf->next = buffers.load(std::memory_order_relaxed);
+		while (!buffers.compare_exchange_weak(buf->next, buf,
+			std::memory_order_release, std::memory_order_relaxed))
+		{
+		}
+		this_buffer = buf;
+	}
+	return *this_buffer;
+}
+
+void copy_detail(char* dest, char const* detail, size_t len)
+{
+	len = std::min(len, detail_size - 1);
+	memcpy(dest, detail, len);
+	dest[len] = '\0';
+}
+
+void append(char const* name, char const* detail, size_t detail_len,
+	uint64_t id, uint64_t parent, uint64_t start, uint64_t duration)
+{
+	thread_buffer& buf = get_buffer();
+
+	unsigned const gen = generation.load(std::memory_order_relaxed);
+	if (buf.generation != gen)
+	{
+		// export may still read the previous blocks
+		buf.retired.push_back(buf.head.load(std::memory_order_relaxed));
+		buf.tail = new block;
+		buf.head.store(buf.tail, std::memory_order_seq_cst);
+		buf.blocks = 1;
+		buf.generation = gen;
+	}
+	// an export started after the head store above reads only the new blocks
+	if (!buf.retired.empty() && readers.load(std::memory_order_seq_cst) == 0)
+	{
+		for (block* b : buf.retired)
+		{
+			delete_blocks(b);
+		}
+		buf.retired.clear();
+	}
+
+	block* b = buf.tail;
+	size_t size = b->size.load(std::memory_order_relaxed);
+	if (size == block::capacity)
+	{
+		if (buf.blocks == thread_buffer::max_blocks)
+		{
+			return;
+		}
+		buf.tail = new block;
+		b->next.store(buf.tail, std::memory_order_release);
+		b = buf.tail;
+		size = 0;
+		++buf.blocks;
+	}
+
+	event& ev = b->events[size];
+	ev.name = name;
+	copy_detail(ev.detail, detail, detail_len);
+	ev.id = id;
+	ev.parent = parent;
+	ev.start = start;
+	ev.duration = duration;
+	b->size.store(size + 1, std::memory_order_release);
+}
+
+void write_string(std::string& out, char const* name, char const* detail)
+{
+	out += '"';
+	std::string str = name;
+	if (*detail)
+	{
+		str += ' ';
+		str += detail;
+	}
+	for (char ch : str)
+	{
+		switch (ch)
+		{
+		case '"':  out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(ch) < 0x20)
+			{
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\u%04x", ch);
+				out += buf;
+			}
+			else
+			{
+				out += ch;
+			}
+		}
+	}
+	out += '"';
+}
+
+void write_us(std::string& out, uint64_t ns)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%llu.%03u",
+		static_cast<unsigned long long>(ns / 1000), static_cast<unsigned>(ns % 1000));
+	out += buf;
+}
+
+} // unnamed namespace
+
+void start()
+{
+	// events of the previous trace are dropped by the owner threads
+	start_time = monotonic_ns();
+	generation.fetch_add(1, std::memory_order_relaxed);
+	active = true;
+}
+
+void stop()
+{
+	active = false;
+}
+
+bool enabled()
+{
+	return active.load(std::memory_order_relaxed);
+}
+
+void record(char const* name, std::string const& detail, uint64_t start_ns, uint64_t duration_ns)
+{
+	if (enabled())
+	{
+		append(name, detail.data(), detail.size(), 0, current_span? current_span->id() : 0,
+			start_ns, duration_ns);
+	}
+}
+
+std::string events_json()
+{
+	std::string const pid = std::to_string(getpid());
+	uint64_t const since = start_time;
+
+	struct read_guard
+	{
+		read_guard() { readers.fetch_add(1, std::memory_order_seq_cst); }
+		~read_guard() { readers.fetch_sub(1, std::memory_order_release); }
+	} guard;
+
+	std::string result = "{\"traceEvents\":[";
+	bool first = true;
+	std::vector<event const*> events;
+	std::unordered_map<uint64_t, event const*> spans;
+	for (thread_buffer* buf = buffers.load(std::memory_order_acquire); buf; buf = buf->next)
+	{
+		events.clear();
+		spans.clear();
+		for (block const* b = buf->head.load(std::memory_order_seq_cst); b;
+			b = b->next.load(std::memory_order_acquire))
+		{
+			size_t const size = b->size.load(std::memory_order_acquire);
+			for (size_t i = 0; i < size; ++i)
+			{
+				event const& ev = b->events[i];
+				if (ev.start < since) continue;
+				events.push_back(&ev);
+				if (ev.id) spans.emplace(ev.id, &ev);
+			}
+		}
+
+		for (event const* ev : events)
+		{
+			result += (first? "\n" : ",\n");
+			first = false;
+			result += "{\"cat\":\"iris-crypt\",\"ph\":\"X\",\"name\":";
+			write_string(result, ev->name, ev->detail);
+			result += ",\"ts\":";
+			write_us(result, ev->start);
+			result += ",\"dur\":";
+			write_us(result, ev->duration);
+			result += ",\"pid\":" + pid + ",\"tid\":" + std::to_string(buf->tid);
+			// a parent span ends after its children, so it is recorded later
+			auto const parent = spans.find(ev->parent);
+			if (parent != spans.end())
+			{
+				result += ",\"args\":{\"parent\":";
+				write_string(result, parent->second->name, parent->second->detail);
+				result += '}';
+			}
+			result += '}';
+		}
+	}
+	result += "\n],\"displayTimeUnit\":\"ms\"}\n";
+	return result;
+}
+
+span::span(char const* name, std::string const& detail)
+	: name_(name)
+	, parent_(nullptr)
+	, id_(0)
+	, start_(0)
+	, active_(enabled())
+{
+	if (active_)
+	{
+		copy_detail(detail_, detail.data(), detail.size());
+		parent_ = current_span;
+		id_ = ++last_span_id;
+		current_span = this;
+		start_ = monotonic_ns();
+	}
+}
+
+span::~span()
+{
+	if (active_)
+	{
+		uint64_t const duration = monotonic_ns() - start_;
+		current_span = parent_;
+		append(name_, detail_, strlen(detail_), id_, parent_? parent_->id() : 0, start_, duration);
+	}
+}
+
+} // namespace trace
@@ -0,0 +1,55 @@
+//
+// Copyright (c) 2015 ASPECTRON Inc.
+// All Rights Reserved.
+//
+// This file is part of IrisCrypt (https://github.com/aspectron/iris-crypt) project.
+//
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Opt-in tracer of nested load and require spans in Chrome trace-event format.
+// Events are appended without locks to per-thread buffers of up to 65536 events
+// by the owner thread only, and may be exported while other threads record.
+namespace trace {
+
+// span details longer than this are truncated
+size_t const detail_size = 96;
+
+void start();
+void stop();
+bool enabled();
+
+// record a span measured by the caller with monotonic_ns(),
+// as a child of the current span of the thread
+void record(char const* name, std::string const& detail, uint64_t start_ns, uint64_t duration_ns);
+
+// JSON object with `traceEvents` array recorded since the last start()
+std::string events_json();
+
+// Scoped span, the spans opened in its scope become its children
+class span
+{
+public:
+	explicit span(char const* name, std::string const& detail = std::string());
+	~span();
+
+	span(span const&) = delete;
+	span& operator=(span const&) = delete;
+
+	uint64_t id() const { return id_; }
+private:
+	char const* name_;
+	char detail_[detail_size];
+	span* parent_;
+	uint64_t id_;
+	uint64_t start_;
+	bool active_;
+};
+
+} // namespace trace
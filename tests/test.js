@@ -8,6 +8,10 @@
 // file LICENSE
 //
 var crypt = require('../');
+var assert = require('assert');
+var child_process = require('child_process');
+var crypto = require('crypto');
+var fs = require('fs');
 var path = require('path');
 
 console.log('crypt exports:', crypt);
@@ -17,6 +21,7 @@ var serial = +process.argv[3] || 1234;
 var filename = process.argv[4] || 'test.pkg';
 
 var auth = crypt.generateAuth(password, serial);
+crypt.startTrace();
 console.log('');
 console.log('generated auth for serial %s: %s', serial, auth);
 
@@ -33,6 +38,95 @@ console.log('');
 console.log('loaded package %s:', filename, pkg);
 console.log('package %s serial:', filename, pkg.serial);
 console.log('package %s names:', filename, pkg.names);
+console.log('package %s inspect:', filename, crypt.inspect(auth, filename));
+console.log('package has m3:', pkg.has('m3'), 'stat m3:', pkg.stat('m3'));
+console.log('package list module3/:', pkg.list('module3/'));
+crypt.package(auth, filename + '.new', {
+	'm1': path.join(__dirname, 'module1.js'),
+	'm2': path.join(__dirname, 'module2.js'),
+});
+console.log('package delta:', crypt.diff(filename, filename + '.new', filename + '.delta'));
+crypt.patch(filename, filename + '.delta', filename + '.patched');
+console.log('package patched:', fs.readFileSync(filename + '.new').equals(fs.readFileSync(filename + '.patched')));
+crypt.package(auth, filename + '.chacha', { 'm1': path.join(__dirname, 'module1.js') }, { cipher: 'chacha20-poly1305' });
+console.log('chacha20-poly1305 package m1:', crypt.load(auth, filename + '.chacha').require('m1'));
+
+console.log('');
+var asset = crypto.randomBytes(3 * 1024 * 1024 + 123);
+var blob_filename = filename + '.blob';
+crypt.package(auth, blob_filename, { 'assets': { 'big.bin': asset } });
+var blob_pkg = crypt.load(auth, blob_filename);
+assert.equal(blob_pkg.stat('assets/big.bin').kind, 'blob');
+assert(blob_pkg.readFile('assets/big.bin').equals(asset));
+assert(blob_pkg.read('assets/big.bin', 64 * 1024 - 10, 100).equals(asset.slice(64 * 1024 - 10, 64 * 1024 + 90)));
+var stream_chunks = [];
+blob_pkg.createReadStream('assets/big.bin', { start: 100, end: 200 * 1024 })
+	.on('data', function(chunk) { stream_chunks.push(chunk); })
+	.on('end', function()
+	{
+		assert(Buffer.concat(stream_chunks).equals(asset.slice(100, 200 * 1024 + 1)));
+		console.log('blob read stream: ok');
+	});
+
+// overwrite a loaded package, its blobs are still read from the previous file
+crypt.package(auth, blob_filename, { 'assets': { 'big.bin': asset } });
+assert(blob_pkg.read('assets/big.bin', 2 * 1024 * 1024, 1000).equals(asset.slice(2 * 1024 * 1024, 2 * 1024 * 1024 + 1000)));
+
+// re-encrypt a blob package in place with the command-line tool
+var cli = path.join(__dirname, '..', 'bin', 'iris-crypt' + (process.platform === 'win32'? '.exe' : ''));
+if (fs.existsSync(cli))
+{
+	var new_auth = crypt.generateAuth('another password', 77);
+	child_process.execFileSync(cli, ['rekey', '-a', auth, '-n', new_auth, blob_filename]);
+	assert(crypt.load(new_auth, blob_filename).readFile('assets/big.bin').equals(asset));
+	assert(blob_pkg.readFile('assets/big.bin').equals(asset));
+}
+console.log('blob package: ok');
+
+// one changed byte in a large file changes only its block in the package
+var changed_asset = Buffer.from(asset);
+changed_asset[1500000] ^= 0xFF;
+crypt.package(auth, blob_filename + '.old', { 'assets': { 'big.bin': asset } });
+crypt.package(auth, blob_filename + '.new', { 'assets': { 'big.bin': changed_asset } });
+var blob_delta = crypt.diff(blob_filename + '.old', blob_filename + '.new', blob_filename + '.delta');
+assert(blob_delta.size < 512 * 1024, 'blob delta size ' + blob_delta.size);
+crypt.patch(blob_filename + '.old', blob_filename + '.delta', blob_filename + '.patched');
+assert(fs.readFileSync(blob_filename + '.new').equals(fs.readFileSync(blob_filename + '.patched')));
+assert(crypt.load(auth, blob_filename + '.patched').readFile('assets/big.bin').equals(changed_asset));
+console.log('blob delta: ok');
+
+// share a package with a child process, its blobs are read from the package file
+if (process.platform === 'linux')
+{
+	var shared_filename = filename + '.shared';
+	crypt.package(auth, shared_filename, { 'm1': path.join(__dirname, 'module1.js'), 'assets': { 'big.bin': asset } });
+	var shared_pkg = crypt.load(auth, shared_filename);
+	var child = child_process.spawnSync(process.execPath, ['-e',
+		'var crypt = require(' + JSON.stringify(path.join(__dirname, '..')) + ');' +
+		'var pkg = crypt.loadShared(process.argv[1], 3);' +
+		'var asset = require("crypto").createHash("sha1").update(pkg.readFile("assets/big.bin")).digest("hex");' +
+		'process.stdout.write(JSON.stringify({ names: pkg.names, f: pkg.require("m1").f(), asset: asset }));',
+		auth], { stdio: ['ignore', 'pipe', 'inherit', shared_pkg.shareMemory()] });
+	assert.deepEqual(JSON.parse(child.stdout), {
+		names: shared_pkg.names,
+		f: shared_pkg.require('m1').f(),
+		asset: crypto.createHash('sha1').update(asset).digest('hex'),
+	});
+	console.log('shared memory package: ok');
+}
+
+// bytecode package is made and loaded in a process started with the required V8 flag
+var v8_version = process.versions.v8.split('.').map(Number);
+var bytecode_flag = (v8_version[0] >= 7? '--no-flush-bytecode' : '--no-lazy');
+var bytecode = child_process.execFileSync(process.execPath, [bytecode_flag, '-e',
+	'var crypt = require(' + JSON.stringify(path.join(__dirname, '..')) + ');' +
+	'var auth = process.argv[1], filename = process.argv[2];' +
+	'crypt.package(auth, filename, { m1: process.argv[3], m2: process.argv[4] }, { bytecode: true });' +
+	'var pkg = crypt.load(auth, filename);' +
+	'process.stdout.write(JSON.stringify({ kind: pkg.stat("m1").kind, f: pkg.require("m2").f() }));',
+	auth, filename + '.bytecode', path.join(__dirname, 'module1.js'), path.join(__dirname, 'module2.js')]);
+assert.deepEqual(JSON.parse(bytecode), { kind: 'bytecode', f: 'module1 in module2' });
+console.log('bytecode package: ok');
 
 console.log('');
 m1 = pkg.require('m1');
@@ -49,3 +143,120 @@ m3 = pkg.require('m3');
 console.log('m3 exports:', m3);
 console.log('m3.f():', m3.f());
 console.log('m3.g():', m3.g());
+
+console.log('');
+console.log('m3 package.json buffer:', pkg.readFile('module3/package.json'));
+console.log('m3 package.json string:', pkg.readFile('module3/package.json', 'utf8'));
+console.log('m3 package.json bytes 2..10:', pkg.read('module3/package.json', 2, 8).toString());
+var json_buf = pkg.readFile('module3/package.json');
+json_buf.fill(0);
+assert.notEqual(pkg.readFile('module3/package.json')[0], 0);
+
+console.log('');
+var pkg_buf = crypt.load(auth, fs.readFileSync(filename));
+console.log('package %s loaded from buffer names:', filename, pkg_buf.names);
+
+var fd = fs.openSync(filename, 'r');
+var pkg_fd = crypt.load(auth, fd, 0);
+fs.closeSync(fd);
+console.log('package %s loaded from fd names:', filename, pkg_fd.names);
+
+console.log('');
+var mem_pkg = crypt.load(auth, crypt.package(auth, null, {
+	'm1': path.join(__dirname, 'module1.js'),
+	'gen': Buffer.from('module.exports = { f: function() { return "generated"; } };'),
+	'vdir': {
+		'package.json': '{ "main": "lib/main.js" }',
+		'lib/main.js': 'module.exports = require("./util");',
+		'lib/util.js': 'exports.f = function() { return "virtual"; };',
+	},
+}));
+console.log('in-memory package names:', mem_pkg.names);
+assert.strictEqual(mem_pkg.prefetch, false);
+assert.equal(mem_pkg.require('gen').f(), 'generated');
+assert.equal(mem_pkg.require('vdir').f(), 'virtual');
+console.log('in-memory package: ok');
+
+// bundled modules give the same exports as separately stored ones
+var bundle_files = {
+	'm1': path.join(__dirname, 'module1.js'),
+	'm2': path.join(__dirname, 'module2.js'),
+	'm3': path.join(__dirname, 'module3'),
+};
+var bundle_pkg = crypt.load(auth, crypt.package(auth, null, bundle_files, { bundle: true }));
+var plain_pkg = crypt.load(auth, crypt.package(auth, null, bundle_files));
+assert.equal(bundle_pkg.stat('m2').kind, 'bundled');
+assert.equal(bundle_pkg.require('m2').f(), plain_pkg.require('m2').f());
+assert.equal(bundle_pkg.require('m3').f(), plain_pkg.require('m3').f());
+assert.equal(bundle_pkg.require('m3').g(), plain_pkg.require('m3').g());
+// bundle package loaded from a file, its sources in the package memory are not wiped
+var bundle_filename = filename + '.bundle';
+crypt.package(auth, bundle_filename, bundle_files, { bundle: true });
+var bundle_file_pkg = crypt.load(auth, bundle_filename);
+assert.equal(bundle_file_pkg.readFile('module1.js', 'utf8'), fs.readFileSync(bundle_files.m1, 'utf8'));
+assert.equal(bundle_file_pkg.require('m2').f(), plain_pkg.require('m2').f());
+assert.equal(crypt.load(auth, bundle_filename).require('m3').f(), plain_pkg.require('m3').f());
+console.log('bundle package: ok');
+
+// a lazy module is evaluated on the first use of its exports
+var lazy_pkg = crypt.load(auth, crypt.package(auth, null, {
+	'm1': path.join(__dirname, 'module1.js'),
+	'm2': path.join(__dirname, 'module2.js'),
+}, { lazy: ['m1'] }));
+var lazy_m2 = lazy_pkg.require('m2');
+assert.equal(lazy_pkg.profile.indexOf('module1.js'), -1);
+assert.equal(lazy_m2.f(), plain_pkg.require('m2').f());
+assert.notEqual(lazy_pkg.profile.indexOf('module1.js'), -1);
+console.log('lazy package: ok');
+
+// only files reachable from the module main file and included ones are stored
+var prune_options = { prune: { include: ['*.txt'] } };
+var prune_pkg = crypt.load(auth, crypt.package(auth, null, {
+	'vdir': {
+		'package.json': '{ "main": "lib/main.js" }',
+		'lib/main.js': 'module.exports = require("./util");',
+		'lib/util.js': 'exports.f = function() { return "virtual"; };',
+		'lib/unused.js': 'exports.f = function() { return "unused"; };',
+		'data/readme.txt': 'kept',
+	},
+}, prune_options));
+assert.deepEqual(prune_pkg.files, ['vdir/data/readme.txt', 'vdir/lib/main.js', 'vdir/lib/util.js', 'vdir/package.json']);
+assert.deepEqual(prune_options.pruned.files, ['vdir/lib/unused.js']);
+assert.equal(prune_pkg.require('vdir').f(), 'virtual');
+console.log('pruned package: ok');
+
+var evict_pkg = crypt.load(auth, crypt.package(auth, null, {
+	'm1': path.join(__dirname, 'module1.js'),
+	'm2': path.join(__dirname, 'module2.js'),
+}, { evictable: true }));
+evict_pkg.memoryLimit = 1;
+console.log('evictable m1.f():', evict_pkg.require('m1').f(), 'm2.f():', evict_pkg.require('m2').f());
+console.log('evictions:', evict_pkg.stats().evictions);
+
+try
+{
+	var worker_threads = require('worker_threads');
+	var worker = new worker_threads.Worker(
+		'var crypt = require(' + JSON.stringify(path.join(__dirname, '..')) + ');' +
+		'var pkg = crypt.attach(require("worker_threads").workerData);' +
+		'console.log("worker attached names:", pkg.names, "gen.f():", pkg.require("gen").f());',
+		{ eval: true, workerData: mem_pkg.share() });
+}
+catch (err)
+{
+	console.log('worker_threads are not available:', err.message);
+}
+
+var pkg_again = crypt.load(auth, filename);
+console.log('package %s loaded again from cache names:', filename, pkg_again.names);
+pkg_again.close();
+console.log('package closed:', pkg_again.closed);
+
+pkg.preload('all', { budgetMs: 2 }, function(err)
+{
+	console.log('preload finished:', err || 'ok', pkg.files);
+});
+
+console.log('startup profile:', pkg.profile);
+console.log('stats:', pkg.stats());
+console.log('trace:', crypt.traceEvents());